@@ -0,0 +1,14 @@
+#pragma once
+
+// Целочисленная арифметика $((...)) и ((...)): 64 бита, операторы C.
+// Выражение один раз разбирается в компактное дерево (массив узлов),
+// константные поддеревья сворачиваются при разборе.
+
+typedef struct ArithProg ArithProg;
+
+ArithProg *arith_compile(const char *);
+int arith_eval(ArithProg *, long long *);
+void arith_free(ArithProg *);
+
+// разбор через кэш по тексту выражения: повторные вычисления не разбирают заново
+int arith_expand(const char *, long long *);
@@ -9,6 +9,7 @@ typedef enum {
     NODE_BACKGROUND,  // &
     NODE_GROUP,       // {}
     NODE_SUB,         // ()
+    NODE_ARITH,       // ((expr))
 } NodeType;
 
 
@@ -19,6 +20,10 @@ typedef enum {
     REDIR_APPEND,    // >>
     REDIR_ERR_OUT,   // &>
     REDIR_ERR_APPEND, // &>>
+    REDIR_RDWR,      // <>
+    REDIR_DUP,       // n>&m, n<&m
+    REDIR_CLOSE,     // n>&-, n<&-
+    REDIR_HEREDOC,   // <<EOF, <<-EOF, <<<word
 } RedirType;
 
 
@@ -26,10 +31,31 @@ typedef enum {
 // перенаправлений в комманде несколько -> используем список для их обработки
 typedef struct Redirection { 
     RedirType type;
-    char  *filename;
+    int fd;          // какой дескриптор меняем (2 в 2>file)
+    int src_fd;      // откуда копируем для REDIR_DUP, готовый дескриптор тела для REDIR_HEREDOC
+    int open_flags;  // флаги open(), вычисляются при разборе
+    int expand;      // как раскрывать тело here-document (HEREDOC_EXPAND_*)
+    int multios;     // >a >b на один дескриптор: MULTIOS_*
+    char  *filename; // для REDIR_HEREDOC - само тело
     struct Redirection *next;
 } Redirection;
 
+#define HEREDOC_EXPAND_NONE 0  // <<'EOF'
+#define HEREDOC_EXPAND_BODY 1  // <<EOF
+#define HEREDOC_EXPAND_WORD 2  // <<<word - раскрывается как обычное слово
+
+#define MULTIOS_NONE   0
+#define MULTIOS_LEADER 1  // первый > группы: src_fd - вход пайпа помощника
+#define MULTIOS_MEMBER 2  // остальные > группы, открывает их помощник
+
+// План перенаправлений команды, собирается при разборе.
+// По нему шелл сохраняет только те дескрипторы, которые реально меняются.
+typedef struct RedirPlan {
+    int n_redirs;   // 0 - перенаправлений нет, ничего не сохраняем
+    int n_touched;
+    int *touched;   // затрагиваемые дескрипторы без повторов
+} RedirPlan;
+
 typedef struct ASTNode { 
     NodeType type;
     // Для разных ситтуаций разное наполнение узла, экономим память и обрабатываем конкртено отдельный случай
@@ -39,17 +65,27 @@ typedef struct ASTNode {
         struct{
             char **argv;
             Redirection *redir;
+            RedirPlan plan;
             int argc;
+            int pure;  // стадия конвейера - встроенная без побочных эффектов (optimize)
         } command;
         // бинарные опператоры
         struct { 
             struct ASTNode *left;
             struct ASTNode *right;
+            int pipe_size;  // для конвейера: pipesize N cmd | cmd, 0 - по опции
         } binary;
         //унарные операторы
         struct {
             struct ASTNode *child;
+            Redirection *redir;  // { list; } >file, ( list ) >file - на всю группу сразу
+            RedirPlan plan;
         } unary;
+        // арифметическая команда: выражение разбирается при первом выполнении
+        struct {
+            char *expr;
+            struct ArithProg *prog;
+        } arith;
     };
 
 } ASTNode;
@@ -59,13 +95,22 @@ ASTNode *create_node(NodeType);
 ASTNode *create_command(char**, Redirection*, int);
 ASTNode *create_binary(NodeType, ASTNode*, ASTNode*);
 ASTNode *create_unary(NodeType, ASTNode*);
+ASTNode *create_arith(const char*);
+void set_unary_redir(ASTNode*, Redirection*);
 
-void add_redir(Redirection**, RedirType, const char*);
+void add_redir(Redirection**, RedirType, int, const char*);
 void free_redir(Redirection*);
+void compile_redir_plan(Redirection*, RedirPlan*);
+void free_redir_plan(RedirPlan*);
 
 
 void free_ast(ASTNode*);
 void print_ast(ASTNode *);
+char *ast_to_string(ASTNode *);
+
+// visit(узел, глубина, arg) для каждого узла сверху вниз, слева направо
+typedef int (*AstVisitor)(ASTNode *, int, void *);
+int ast_walk(ASTNode *, AstVisitor, void *);
 
 
 
@@ -1,7 +1,25 @@
 #pragma once 
 
 #include "ast.h"
+#include <stddef.h>
 
+// флаги встроенных команд
+#define BUILTIN_UTIL 1    // опциональная утилита, отключается через set +o builtin-utils
+#define BUILTIN_NOFORK 2  // не меняет состояние шелла, в $(...) выполняется без fork
+
+// встроенная команда не справилась с аргументами - выполняем внешнюю программу
+#define BUILTIN_DEFER -2
+
+typedef int (*builtin_fn)(char **);
+
+typedef struct Builtin {
+    const char *name;
+    builtin_fn fn;
+    int flags;
+} Builtin;
+
+const Builtin *find_builtin(const char *);
+const Builtin *builtin_list(size_t *);
 int is_builtin(const char *);
 
 int builtin_cd(char **argv);
@@ -10,11 +28,26 @@ int builtin_pwd(char **argv);
 int builtin_echo(char **argv);
 int builtin_help(char **argv);
 int builtin_jobs(char **argv);
+int builtin_history(char **argv);
 int builtin_kill(char **argv);
 int builtin_fg(char **argv);
 int builtin_bg(char **argv);
 int builtin_set(char **argv);
 int builtin_unset(char **argv);
+int builtin_wait(char **argv);
+int builtin_timeout(char **argv);
+int builtin_limit(char **argv);
+int builtin_affinity(char **argv);
+
+// утилиты (src/coreutils.c)
+int builtin_true(char **argv);
+int builtin_false(char **argv);
+int builtin_cat(char **argv);
+int builtin_test(char **argv);
+int builtin_printf(char **argv);
+int builtin_basename(char **argv);
+int builtin_dirname(char **argv);
+void test_cache_reset(void);
 
 int run_builtin(char **);
 int run_builtin_with_redir(ASTNode *);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Дополнение по Tab. Имя команды ищется в индексе исполняемых файлов PATH
+// и среди встроенных команд; остальные слова (и команды со '/') - имена файлов.
+// Индекс PATH строится один раз (getdents64 + faccessat) и держится отсортированным;
+// каталог перечитывается, только если сменилось его mtime или он впервые появился
+// в PATH. Содержимое каталогов для имен файлов кэшируется так же, по mtime.
+
+typedef struct {
+    char **items;  // готовые замены слова, уже с экранированием и '/' или ' ' в конце
+    size_t n;
+    size_t start;  // заменяется line[start .. pos)
+} Completion;
+
+int complete(const char *, size_t, Completion *);
+void completion_free(Completion *);
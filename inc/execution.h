@@ -8,7 +8,12 @@
 
 
 int handle_redirection(Redirection *);
-void expand_argv(char **);
+int prepare_heredocs(Redirection *);
+void release_heredocs(Redirection *);
+int save_redir_fds(RedirPlan *, int *);
+void restore_redir_fds(RedirPlan *, int *);
+int expand_command(ASTNode *);
+int expand_redirs(Redirection *);
 int exec_command_in_child(ASTNode *);
 int flatten_pipeline(ASTNode *,ASTNode ***, int **, int *);
 int wait_foreground_pgid(pid_t, pid_t);
@@ -17,3 +22,4 @@ int execute_pipeline_node(ASTNode*);
 int execute_internal(ASTNode*, int);
 int execute_command(ASTNode *);
 int execute(ASTNode *);
+int execute_tail(ASTNode *);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+// режимы раскрытия
+#define EXPAND_WORD    0  // обычное слово из лексера
+#define EXPAND_HEREDOC 1  // тело here-document: \ экранирует только $ ` \ и перевод строки
+
+int needs_expansion(const char *);
+char *expand_word(const char *, int);
+int expand_fields(const char *, char ***, int *);
+char *command_substitution(const char *, size_t *);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+// История команд: журнал $HISTFILE (по умолчанию ~/.mybash_history), одна команда на строку;
+// переводы строк многострочной команды записаны как \n, обратная косая черта - как \\.
+// Новая запись дописывается одним write через O_APPEND - несколько шеллов пишут
+// в один файл, не перемешивая строки. При запуске файл только отображается (mmap);
+// на строки он делится при первом обращении к истории, а триграммный индекс для
+// поиска (Ctrl-R, history -g) строится при первом поиске.
+
+#define HISTORY_NONE ((size_t)-1)
+
+int history_open(const char *);
+void history_close(void);
+void history_add(const char *);
+
+// записи нумеруются с 0 от самой старой; строка записи не заканчивается '\0'
+// и действительна до следующего вызова history_entry
+size_t history_count(void);
+const char *history_entry(size_t, size_t *);
+
+// самая новая запись среди [0, before), содержащая подстроку; HISTORY_NONE - нет такой
+size_t history_search(const char *, size_t);
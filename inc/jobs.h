@@ -1,6 +1,8 @@
 #pragma once 
 
+#include "rlimits.h"
 #include <sys/types.h>
+#include <termios.h>
 
 typedef enum { 
     JOB_RUNNING,
@@ -8,23 +10,53 @@ typedef enum {
     JOB_DONE
 } JobStatus;
 
+// процесс задания - по одному на стадию конвейера, в порядке стадий
+typedef struct Process {
+    struct Process *next;
+    pid_t pid;
+    int pidfd;       // ожидание без гонок с переиспользованием пида, -1 - нет
+    int completed;
+    int stopped;
+    int status;      // статус из waitpid
+} Process;
+
 typedef struct Job{
     char *command;
     pid_t pgid;
     int id;
     JobStatus status;
     int is_background;
+    JobLimits limits;  // limit и bgnice, показываются в jobs -l
+    struct termios tmodes;  // режимы терминала остановленного задания (vim и т.п.)
+    int has_tmodes;
+    Process *first_process;
     struct Job *next;
 } Job;
 
 
-void init_shell();
-void add_job(pid_t, const char*, JobStatus, int);
+// флаги jobs_wait
+#define JOB_WAIT_ANY  1  // хватит первого завершившегося задания (wait -n)
+#define JOB_WAIT_STOP 2  // остановка задания тоже конец ожидания (передний план)
+
+// результаты jobs_wait кроме индекса задания
+#define JOB_WAIT_STOPPED (-1)
+#define JOB_WAIT_TIMEOUT (-2)
+
+extern pid_t shell_pid;
+
+void init_shell(int);
+Job *add_job(pid_t, const char*, JobStatus, int);
+void job_add_process(Job *, pid_t);
+int mark_process_status(pid_t, int);
 void delete_job(pid_t);
 Job *find_job_by_pgid(pid_t);
 Job *find_job_by_id(int);
 void wait_for_job(Job *);
+int jobs_wait(Job **, int, int, int);
+int job_exit_code(Job *);
 void check_background_jobs();
+void terminal_to_job(Job *);
+void terminal_to_shell(pid_t);
 
 
 
@@ -3,6 +3,11 @@
 #include <stdlib.h>
 
 extern const char word_delimeters[];
+
+// служебные байты в значениях слов, их снимает раскрытие (expand.c)
+#define LEX_ESC '\001'    // следующий символ буквальный ('$' из '' или \$)
+#define LEX_QUOTED '\002' // слово было в "" и содержит подстановки - не делится на поля
+#define LEX_PROCSUBST '\003' // слово - подстановка процесса <(cmd) или >(cmd)
 typedef enum{
     SIMPLE_WORD,
     WORD_IN_QUOTES,
@@ -18,3 +23,4 @@ void print(Token *array_token);
 void free_tokens(Token *array_token);
 Token create_token(TokenType type, char *value);
 Token *tokenize(const char *input);
+size_t subst_len(const char *input, size_t j);
@@ -0,0 +1,14 @@
+#pragma once
+
+// Редактор строки для интерактивного шелла: raw-режим termios, курсор по символам UTF-8,
+// kill/yank, история (inc/history.h) и поиск по ней через Ctrl-R. Каждое нажатие
+// перерисовывает только изменившийся хвост строки одним write; терминал возвращается
+// в исходный режим до выполнения команды.
+
+// результат lineedit_read
+#define LINEEDIT_OK    0  // строка в *out (malloc)
+#define LINEEDIT_EOF   1  // Ctrl-D на пустой строке или конец ввода
+#define LINEEDIT_INTR  2  // Ctrl-C: строка брошена
+#define LINEEDIT_PASTE 3  // в *out вставка из нескольких строк (bracketed paste), без последнего '\n'
+
+int lineedit_read(const char *, char **);
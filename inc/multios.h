@@ -0,0 +1,10 @@
+#pragma once
+
+#include "ast.h"
+
+// Multios: cmd >a >b >>c пишет во все файлы сразу.
+// Команда пишет в пайп, помощник раздает данные по файлам через tee(2)/splice(2).
+
+int multios_prepare(Redirection *);
+void multios_release(Redirection *);
+void multios_wait(int);
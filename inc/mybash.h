@@ -0,0 +1,46 @@
+#pragma once
+
+// libmybash: лексер, парсер и исполнитель как библиотека (libmybash.a / libmybash.so).
+//
+//     MyBash *sh = mybash_new(0);
+//     int rc = mybash_run(sh, "ls | wc -l > count.txt", 0);
+//     mybash_free(sh);
+//
+// Разбор и выполнение по шагам: tokenize() -> parse() -> mybash_execute(),
+// дерево можно обойти через ast_walk(), освободить - free_ast() и free_tokens().
+// Состояние ($?, $!, задания, set -o) живет в MyBash; переменные окружения,
+// текущий каталог и дескрипторы общие для процесса. Экземпляры не потокобезопасны:
+// одновременно выполняется только один.
+
+#include "ast.h"
+#include "token.h"
+
+typedef struct MyBash MyBash;
+
+// флаги mybash_new
+#define MYBASH_JOB_CONTROL 1  // управление заданиями, если stdin - терминал (как интерактивный шелл)
+
+// флаги mybash_run
+#define MYBASH_RUN_TAIL 1     // последняя команда заменяет процесс (exec без fork), как mybash -c
+
+MyBash *mybash_new(int);
+void mybash_free(MyBash *);
+void mybash_use(MyBash *);
+
+int mybash_run(MyBash *, const char *, int);
+int mybash_execute(MyBash *, ASTNode *);
+int mybash_status(MyBash *);
+int mybash_incomplete(MyBash *);
+
+// exit завершает не процесс, а выполнение: оставшиеся команды строки пропускаются,
+// mybash_run возвращает код exit, а mybash_exited() - 1 до следующего mybash_run
+int mybash_exited(MyBash *);
+
+// разбор без выполнения: tokenize и parse используют текущий экземпляр (mybash_use)
+Token *tokenize(const char *);
+void free_tokens(Token *);
+ASTNode *parse(Token *);
+
+// set -o zygote запускает помощника как "программа --zygote", поэтому программа
+// с библиотекой начинает main() с: int rc = mybash_zygote(argc, argv); if (rc >= 0) return rc;
+int mybash_zygote(int, char **);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "ast.h"
+
+// Переписывание дерева перед выполнением (set -o optimize): убирает процессы,
+// которые ничего не делают. С set -o optimize-debug каждое правило пишет в stderr,
+// что и во что переписано.
+ASTNode *optimize_ast(ASTNode *);
@@ -0,0 +1,23 @@
+#pragma once
+
+// опции шелла, управляемые через set -o name / set +o name
+typedef enum {
+    OPT_BUILTIN_UTILS, // cat, test, printf и т.д. выполняются внутри шелла
+    OPT_PIPESIZE,      // pipesize=N: емкость пайпов конвейера (F_SETPIPE_SZ)
+    OPT_PIPEFAIL,      // код конвейера - последней упавшей стадии, а не последней
+    OPT_CPUSPREAD,     // стадии конвейера раскладываются по доступным ядрам по кругу
+    OPT_BGNICE,        // bgnice=N: задания с & получают nice N и низкий приоритет ввода-вывода
+    OPT_OPTIMIZE,      // переписывание дерева перед выполнением (optimize.c)
+    OPT_OPTIMIZE_DEBUG, // отчет о каждом переписывании в stderr
+    OPT_ZYGOTE,        // внешние команды порождает помощник zygote, а не fork шелла
+    OPT_COUNT
+} ShellOption;
+
+struct OptionState;
+
+void options_init(struct OptionState *);
+int get_option(ShellOption);
+long get_option_value(ShellOption);
+int set_option(const char *, int);
+void print_options(void);
+int parse_size(const char *, long *);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+// Буфер вывода встроенных команд.
+// Данные копятся в памяти шелла и уходят одним write/writev: при заполнении,
+// перед fork, перед сменой дескриптора (перенаправление) и перед приглашением.
+
+#define OUTBUF_SIZE (64 * 1024)
+
+// сохраненное состояние stdout на время перехвата вывода
+typedef struct OutCapture {
+    char *data;
+    size_t len;
+    size_t cap;
+    int capturing;
+} OutCapture;
+
+int out_write(int, const void *, size_t);
+int out_puts(int, const char *);
+int out_putc(int, char);
+int out_printf(int, const char *, ...) __attribute__((format(printf, 2, 3)));
+int out_errorf(const char *, ...) __attribute__((format(printf, 1, 2)));
+void out_perror(const char *);
+int out_flush(int);
+void out_flush_all(void);
+void out_capture_begin(OutCapture *);
+char *out_capture_end(OutCapture *, size_t *);
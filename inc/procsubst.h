@@ -0,0 +1,14 @@
+#pragma once
+
+#include <sys/types.h>
+
+// Подстановка процессов <(cmd) и >(cmd).
+// Помощники запускаются во время раскрытия аргументов команды, до её fork,
+// и попадают в ту же группу процессов, что и сама команда.
+
+char *procsubst_open(const char *, int);
+pid_t procsubst_pgid(void);
+void procsubst_exec_prepare(void);
+int procsubst_fds(const int **);
+int procsubst_release(pid_t **);
+void procsubst_wait(pid_t *, int);
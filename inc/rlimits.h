@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+// ограничения задания: limit -m 2G -t 60 -n 10 -io idle cmd ...
+// применяются в дочернем процессе перед exec и запоминаются в Job для jobs -l
+
+// какие поля JobLimits заданы
+#define LIMIT_MEM  1  // -m: адресное пространство (RLIMIT_AS)
+#define LIMIT_CPU  2  // -t: процессорное время в секундах (RLIMIT_CPU)
+#define LIMIT_NICE 4  // -n: значение nice
+#define LIMIT_IO   8  // -io: класс и уровень приоритета ввода-вывода
+#define LIMIT_CPUS 16 // -c: набор ядер (sched_setaffinity)
+
+// cpu_set_t требует _GNU_SOURCE у всех, кто включает jobs.h, поэтому своя битовая маска
+#define LIMIT_MAX_CPUS 1024
+#define LIMIT_CPU_WORDS (LIMIT_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+typedef struct JobLimits {
+    int set;
+    rlim_t mem;
+    rlim_t cpu;
+    int nice;
+    int ioclass;  // IOPRIO_CLASS_RT / BE / IDLE
+    int iolevel;  // 0 (высший) .. 7 для rt и be
+    unsigned long cpus[LIMIT_CPU_WORDS];
+} JobLimits;
+
+int limits_parse(char **, JobLimits *, int);
+int limits_apply(const JobLimits *);
+int limits_background(JobLimits *);
+int limits_spread(int, JobLimits *);
+int parse_cpu_list(const char *, JobLimits *);
+void limits_merge(JobLimits *, const JobLimits *);
+void limits_format(const JobLimits *, char *, size_t);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mybash.h"
+
+// Режим сервера: mybash --server PATH [--max-clients N].
+// Клиенты подключаются к Unix-сокету и присылают командные строки:
+// либо строкой до '\n', либо кадром "\0" + длина (4 байта, big-endian) + текст.
+// Вместе с запросом через SCM_RIGHTS можно передать stdin, stdout и stderr
+// (по порядку; недостающие - /dev/null). На каждый запрос сервер отвечает строкой
+// "status N utime S stime S childrss KB\n": код, время процессора на запрос
+// (обработчик и его дети) и пиковый RSS самого большого из завершившихся детей
+// за всё соединение. exit отвечает своим кодом и закрывает соединение.
+// Каждое соединение обслуживает отдельный процесс-обработчик, их не больше N;
+// состояние шелла (set VAR=..., set -o ...) живет в пределах соединения.
+
+#define SERVER_MAX_CLIENTS 16
+
+int server_main(MyBash *, const char *, int);
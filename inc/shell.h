@@ -0,0 +1,29 @@
+#pragma once
+
+#include "jobs.h"
+#include "options.h"
+#include <sys/types.h>
+
+// Состояние одного экземпляра шелла - всё, что меняется при выполнении команд.
+// Исполнитель работает с текущим экземпляром g_sh; его выбирают функции mybash_*
+// (mybash.h), бинарник создает один экземпляр на весь процесс.
+
+typedef struct OptionState {
+    int enabled;
+    long value;
+} OptionState;
+
+struct MyBash {
+    int last_status;                 // $?
+    pid_t last_bg_pgid;              // $!
+    int *pipestatus;                 // ${PIPESTATUS[i]} - коды стадий последнего конвейера
+    int pipestatus_n;
+    int pipestatus_cap;
+    Job *first_job;                  // голова списка заданий
+    int unclosed_quote;              // tokenize: строка оборвалась внутри кавычек
+    int unclosed_heredoc;            // tokenize: here-document не дочитан
+    OptionState options[OPT_COUNT];  // set -o / set +o
+    int exited;                      // выполнен exit: остальные команды строки пропускаются
+};
+
+extern struct MyBash *g_sh;
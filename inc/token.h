@@ -17,6 +17,14 @@ typedef enum {
     TOKEN_WORD_IN_QUOTES, // "/'
     TOKEN_LPAREN, // (
     TOKEN_RPAREN, // )
+    TOKEN_IO_NUMBER, // 2 в 2>file
+    TOKEN_REDIR_DUP_OUT, // >&
+    TOKEN_REDIR_DUP_IN, // <&
+    TOKEN_REDIR_RDWR, // <>
+    TOKEN_HEREDOC, // <<EOF, значение - тело документа
+    TOKEN_HEREDOC_RAW, // <<'EOF', тело без раскрытия переменных
+    TOKEN_HERESTRING, // <<<
+    TOKEN_ARITH, // ((expr)), значение - само выражение
     TOKEN_EOF // ну тут и так понятно
 } TokenType;
 
@@ -27,7 +35,7 @@ typedef struct Token {
 } Token;
 
 
-// | |& ||  > < >> & && &> &>> ; 
+// | |& ||  > < >> & && &> &>> ; >& <& <>
 
 
 
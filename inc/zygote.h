@@ -0,0 +1,17 @@
+#pragma once
+
+#include "ast.h"
+#include <sys/types.h>
+
+// Zygote: маленький помощник для запуска внешних команд (set -o zygote).
+// Шелл один раз запускает свой же бинарник с --zygote и дальше передает ему
+// по socketpair argv, изменения окружения и готовые дескрипторы (SCM_RIGHTS).
+// Помощник делает clone(CLONE_PARENT): ребенок - сын шелла, его ждет waitpid,
+// а цена порождения не зависит от размера кучи шелла.
+
+#define ZYGOTE_ARG "--zygote"
+#define ZYGOTE_FD  3  // сокет помощника после exec
+
+int zygote_main(int);
+pid_t zygote_spawn(ASTNode *, pid_t);
+void zygote_stop(void);
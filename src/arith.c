@@ -0,0 +1,614 @@
+#include "../inc/arith.h"
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+// Разбор - рекурсивный спуск с приоритетами как в C, результат - массив узлов,
+// дети ссылаются на узлы по индексам. Переменные берутся из окружения,
+// присваивания пишут туда же (setenv).
+
+#define ARITH_CACHE_SIZE 64  // кэш разобранных выражений $((...)) по тексту
+#define ARITH_MAX_DEPTH  32  // вложенность значений переменных-выражений
+
+typedef enum {
+    A_NUM, A_VAR,
+    A_NEG, A_POS, A_NOT, A_BNOT,
+    A_PREINC, A_PREDEC, A_POSTINC, A_POSTDEC,
+    A_MUL, A_DIV, A_MOD, A_ADD, A_SUB, A_SHL, A_SHR,
+    A_LT, A_LE, A_GT, A_GE, A_EQ, A_NE,
+    A_BAND, A_BXOR, A_BOR, A_LAND, A_LOR,
+    A_COMMA, A_COND, A_ASSIGN,
+} ArithOp;
+
+typedef struct {
+    unsigned char op;
+    unsigned char aop; // A_ASSIGN: операция составного присваивания, A_NUM - простое =
+    int a, b, c;       // дети
+    long long num;
+    char *name;        // A_VAR, A_ASSIGN, ++/--
+} ArithNode;
+
+struct ArithProg {
+    ArithNode *nodes;
+    int n;
+    int cap;
+    int root;
+};
+
+typedef struct {
+    const char *s;
+    size_t pos;
+    ArithProg *p;
+    int err;
+} ArithParser;
+
+typedef struct {
+    int err;
+    int depth;
+} ArithCtx;
+
+
+// ---------- вычисление одной операции (общее для свертки и выполнения) ----------
+
+static long long apply_unary(int op, long long x) {
+    switch (op) {
+        case A_NEG:  return (long long)(0ULL - (unsigned long long)x);
+        case A_POS:  return x;
+        case A_NOT:  return !x;
+        case A_BNOT: return ~x;
+    }
+    return 0;
+}
+
+// сложение и умножение - с переполнением по модулю 2^64, как в bash
+static long long apply_binary(int op, long long x, long long y, int *err) {
+    switch (op) {
+        case A_MUL: return (long long)((unsigned long long)x * (unsigned long long)y);
+        case A_ADD: return (long long)((unsigned long long)x + (unsigned long long)y);
+        case A_SUB: return (long long)((unsigned long long)x - (unsigned long long)y);
+        case A_DIV:
+        case A_MOD:
+            if (y == 0) {
+                out_errorf("arithmetic: division by zero\n");
+                *err = 1;
+                return 0;
+            }
+            if (x == LLONG_MIN && y == -1) return op == A_DIV ? LLONG_MIN : 0;
+            return op == A_DIV ? x / y : x % y;
+        case A_SHL:  return (long long)((unsigned long long)x << (y & 63));
+        case A_SHR:  return x >> (y & 63);
+        case A_LT:   return x < y;
+        case A_LE:   return x <= y;
+        case A_GT:   return x > y;
+        case A_GE:   return x >= y;
+        case A_EQ:   return x == y;
+        case A_NE:   return x != y;
+        case A_BAND: return x & y;
+        case A_BXOR: return x ^ y;
+        case A_BOR:  return x | y;
+        case A_LAND: return x && y;
+        case A_LOR:  return x || y;
+        case A_COMMA: return y;
+    }
+    return 0;
+}
+
+
+// ---------- разбор ----------
+
+// число: 123, 0x1f, 017, base#digits
+static int parse_number(const char *s, size_t *pos, long long *out) {
+    size_t i = *pos;
+    if (!isdigit((unsigned char)s[i])) return 0;
+
+    int base = 10;
+    if (s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X')) {
+        base = 16;
+        i += 2;
+    } else if (s[i] == '0') {
+        base = 8;
+    } else {
+        size_t j = i;
+        long b = 0;
+        while (isdigit((unsigned char)s[j]) && b <= 64) b = b * 10 + (s[j++] - '0');
+        if (s[j] == '#' && b >= 2 && b <= 36) {
+            base = (int)b;
+            i = j + 1;
+        }
+    }
+
+    unsigned long long v = 0;
+    size_t start = i;
+    while (s[i]) {
+        int d;
+        char c = s[i];
+        if (isdigit((unsigned char)c)) d = c - '0';
+        else if (isalpha((unsigned char)c)) d = tolower((unsigned char)c) - 'a' + 10;
+        else break;
+        if (d >= base) return 0; // 09, 0xg, 2#3
+        v = v * base + d;
+        i++;
+    }
+    if (i == start && base != 8) return 0;
+
+    *out = (long long)v;
+    *pos = i;
+    return 1;
+}
+
+static int is_name_start(char c) {
+    return c == '_' || isalpha((unsigned char)c);
+}
+
+static void skip_ws(ArithParser *ps) {
+    while (isspace((unsigned char)ps->s[ps->pos])) ps->pos++;
+}
+
+static int new_node(ArithParser *ps, int op) {
+    ArithProg *p = ps->p;
+    if (p->n >= p->cap) {
+        int cap = p->cap ? p->cap * 2 : 16;
+        ArithNode *tmp = realloc(p->nodes, sizeof(ArithNode) * cap);
+        if (!tmp) {
+            ps->err = 1;
+            return -1;
+        }
+        p->nodes = tmp;
+        p->cap = cap;
+    }
+
+    ArithNode *n = &p->nodes[p->n];
+    memset(n, 0, sizeof(*n));
+    n->op = op;
+    n->a = n->b = n->c = -1;
+    return p->n++;
+}
+
+static int num_node(ArithParser *ps, long long v) {
+    int i = new_node(ps, A_NUM);
+    if (i >= 0) ps->p->nodes[i].num = v;
+    return i;
+}
+
+static int name_node(ArithParser *ps, int op) {
+    size_t start = ps->pos;
+    while (is_name_start(ps->s[ps->pos]) || isdigit((unsigned char)ps->s[ps->pos])) ps->pos++;
+
+    int i = new_node(ps, op);
+    if (i < 0) return -1;
+    ps->p->nodes[i].name = strndup(ps->s + start, ps->pos - start);
+    if (!ps->p->nodes[i].name) ps->err = 1;
+    return i;
+}
+
+static int is_num(ArithParser *ps, int i) {
+    return i >= 0 && ps->p->nodes[i].op == A_NUM;
+}
+
+// константы сворачиваем сразу: дети - последние узлы массива, их место освобождается
+static int make_unary(ArithParser *ps, int op, int a) {
+    if (ps->err) return -1;
+    if (is_num(ps, a) && a == ps->p->n - 1) {
+        ps->p->nodes[a].num = apply_unary(op, ps->p->nodes[a].num);
+        return a;
+    }
+    int i = new_node(ps, op);
+    if (i >= 0) ps->p->nodes[i].a = a;
+    return i;
+}
+
+static int make_binary(ArithParser *ps, int op, int a, int b) {
+    if (ps->err) return -1;
+    ArithNode *nodes = ps->p->nodes;
+
+    if (is_num(ps, a) && is_num(ps, b) && a == ps->p->n - 2 && b == ps->p->n - 1 &&
+        !((op == A_DIV || op == A_MOD) && nodes[b].num == 0)) { // деление на 0 - ошибка при выполнении
+        int err = 0;
+        nodes[a].num = apply_binary(op, nodes[a].num, nodes[b].num, &err);
+        ps->p->n--;
+        return a;
+    }
+
+    int i = new_node(ps, op);
+    if (i < 0) return -1;
+    ps->p->nodes[i].a = a;
+    ps->p->nodes[i].b = b;
+    return i;
+}
+
+static const struct {
+    const char *text;
+    int op;
+    int prec;
+} binops[] = {
+    { "||", A_LOR, 1 },  { "&&", A_LAND, 2 },
+    { "==", A_EQ, 6 },   { "!=", A_NE, 6 },
+    { "<=", A_LE, 7 },   { ">=", A_GE, 7 },
+    { "<<", A_SHL, 8 },  { ">>", A_SHR, 8 },
+    { "|", A_BOR, 3 },   { "^", A_BXOR, 4 },  { "&", A_BAND, 5 },
+    { "<", A_LT, 7 },    { ">", A_GT, 7 },
+    { "+", A_ADD, 9 },   { "-", A_SUB, 9 },
+    { "*", A_MUL, 10 },  { "/", A_DIV, 10 },  { "%", A_MOD, 10 },
+};
+
+static const struct {
+    const char *text;
+    int op;
+} assignops[] = {
+    { "<<=", A_SHL }, { ">>=", A_SHR },
+    { "*=", A_MUL },  { "/=", A_DIV },  { "%=", A_MOD },
+    { "+=", A_ADD },  { "-=", A_SUB },
+    { "&=", A_BAND }, { "^=", A_BXOR }, { "|=", A_BOR },
+    { "=", A_NUM },
+};
+
+// индекс бинарного оператора в позиции разбора или -1 (a += ... - не бинарный)
+static int match_binop(ArithParser *ps, size_t *len) {
+    const char *s = ps->s + ps->pos;
+    for (size_t i = 0; i < sizeof(binops) / sizeof(binops[0]); ++i) {
+        size_t n = strlen(binops[i].text);
+        if (strncmp(s, binops[i].text, n) != 0) continue;
+
+        int op = binops[i].op;
+        if (s[n] == '=' && op != A_EQ && op != A_NE && op != A_LE && op != A_GE) return -1;
+        *len = n;
+        return (int)i;
+    }
+    return -1;
+}
+
+static int parse_comma(ArithParser *ps);
+static int parse_assign(ArithParser *ps);
+
+static int parse_primary(ArithParser *ps) {
+    skip_ws(ps);
+    const char *s = ps->s;
+
+    if (s[ps->pos] == '(') {
+        ps->pos++;
+        int e = parse_comma(ps);
+        skip_ws(ps);
+        if (s[ps->pos] != ')') {
+            ps->err = 1;
+            return -1;
+        }
+        ps->pos++;
+        return e;
+    }
+
+    long long v;
+    if (parse_number(s, &ps->pos, &v)) {
+        if (is_name_start(s[ps->pos])) { // 12abc
+            ps->err = 1;
+            return -1;
+        }
+        return num_node(ps, v);
+    }
+
+    if (is_name_start(s[ps->pos])) {
+        int var = name_node(ps, A_VAR);
+        if (var < 0) return -1;
+
+        // постфиксные x++ и x--
+        size_t save = ps->pos;
+        skip_ws(ps);
+        if ((s[ps->pos] == '+' || s[ps->pos] == '-') && s[ps->pos + 1] == s[ps->pos]) {
+            ps->p->nodes[var].op = s[ps->pos] == '+' ? A_POSTINC : A_POSTDEC;
+            ps->pos += 2;
+        } else {
+            ps->pos = save;
+        }
+        return var;
+    }
+
+    ps->err = 1;
+    return -1;
+}
+
+static int parse_unary(ArithParser *ps) {
+    skip_ws(ps);
+    char c = ps->s[ps->pos];
+
+    // префиксные ++x и --x
+    if ((c == '+' || c == '-') && ps->s[ps->pos + 1] == c) {
+        ps->pos += 2;
+        skip_ws(ps);
+        if (!is_name_start(ps->s[ps->pos])) {
+            ps->err = 1;
+            return -1;
+        }
+        return name_node(ps, c == '+' ? A_PREINC : A_PREDEC);
+    }
+
+    if (c == '-' || c == '+' || c == '!' || c == '~') {
+        ps->pos++;
+        int a = parse_unary(ps);
+        int op = c == '-' ? A_NEG : c == '+' ? A_POS : c == '!' ? A_NOT : A_BNOT;
+        return make_unary(ps, op, a);
+    }
+
+    return parse_primary(ps);
+}
+
+// бинарные операторы методом приоритетов, все левоассоциативные
+static int parse_binary(ArithParser *ps, int min_prec) {
+    int left = parse_unary(ps);
+
+    while (!ps->err) {
+        skip_ws(ps);
+        size_t len = 0;
+        int i = match_binop(ps, &len);
+        if (i < 0 || binops[i].prec < min_prec) break;
+
+        ps->pos += len;
+        int right = parse_binary(ps, binops[i].prec + 1);
+        left = make_binary(ps, binops[i].op, left, right);
+    }
+    return left;
+}
+
+static int parse_ternary(ArithParser *ps) {
+    int cond = parse_binary(ps, 1);
+    if (ps->err) return -1;
+
+    skip_ws(ps);
+    if (ps->s[ps->pos] != '?') return cond;
+    ps->pos++;
+
+    int then = parse_comma(ps);
+    skip_ws(ps);
+    if (ps->err || ps->s[ps->pos] != ':') {
+        ps->err = 1;
+        return -1;
+    }
+    ps->pos++;
+    int other = parse_assign(ps);
+    if (ps->err) return -1;
+
+    // известное условие - ветка выбирается при разборе
+    if (is_num(ps, cond)) return ps->p->nodes[cond].num ? then : other;
+
+    int i = new_node(ps, A_COND);
+    if (i < 0) return -1;
+    ps->p->nodes[i].a = cond;
+    ps->p->nodes[i].b = then;
+    ps->p->nodes[i].c = other;
+    return i;
+}
+
+static int parse_assign(ArithParser *ps) {
+    skip_ws(ps);
+    const char *s = ps->s;
+    size_t save = ps->pos;
+
+    if (is_name_start(s[ps->pos])) {
+        size_t start = ps->pos;
+        while (is_name_start(s[ps->pos]) || isdigit((unsigned char)s[ps->pos])) ps->pos++;
+        size_t end = ps->pos;
+        skip_ws(ps);
+
+        for (size_t i = 0; i < sizeof(assignops) / sizeof(assignops[0]); ++i) {
+            size_t n = strlen(assignops[i].text);
+            if (strncmp(s + ps->pos, assignops[i].text, n) != 0) continue;
+            if (assignops[i].op == A_NUM && s[ps->pos + 1] == '=') break; // ==
+
+            ps->pos += n;
+            int value = parse_assign(ps);
+            if (ps->err) return -1;
+
+            int node = new_node(ps, A_ASSIGN);
+            if (node < 0) return -1;
+            ps->p->nodes[node].aop = assignops[i].op;
+            ps->p->nodes[node].a = value;
+            ps->p->nodes[node].name = strndup(s + start, end - start);
+            if (!ps->p->nodes[node].name) ps->err = 1;
+            return node;
+        }
+        ps->pos = save;
+    }
+
+    return parse_ternary(ps);
+}
+
+static int parse_comma(ArithParser *ps) {
+    int left = parse_assign(ps);
+    while (!ps->err) {
+        skip_ws(ps);
+        if (ps->s[ps->pos] != ',') break;
+        ps->pos++;
+        int right = parse_assign(ps);
+        left = make_binary(ps, A_COMMA, left, right);
+    }
+    return left;
+}
+
+ArithProg *arith_compile(const char *expr) {
+    ArithProg *p = calloc(1, sizeof(ArithProg));
+    if (!p) {
+        out_perror("calloc");
+        return NULL;
+    }
+
+    ArithParser ps = { expr, 0, p, 0 };
+    skip_ws(&ps);
+
+    // пустое выражение равно 0
+    if (!expr[ps.pos]) {
+        p->root = num_node(&ps, 0);
+    } else {
+        p->root = parse_comma(&ps);
+        skip_ws(&ps);
+        if (expr[ps.pos]) ps.err = 1;
+    }
+
+    if (ps.err || p->root < 0) {
+        out_errorf("%s: syntax error in expression (error token is \"%s\")\n",
+                expr, expr + ps.pos);
+        arith_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void arith_free(ArithProg *p) {
+    if (!p) return;
+    for (int i = 0; i < p->n; ++i) free(p->nodes[i].name);
+    free(p->nodes);
+    free(p);
+}
+
+
+// ---------- выполнение ----------
+
+static long long eval_node(ArithProg *p, int i, ArithCtx *ctx);
+
+// значение переменной: пусто - 0, число - как есть, иначе вычисляем как выражение
+static long long get_var(const char *name, ArithCtx *ctx) {
+    const char *v = getenv(name);
+    if (!v) return 0;
+
+    size_t pos = 0;
+    while (isspace((unsigned char)v[pos])) pos++;
+    if (!v[pos]) return 0;
+
+    int neg = v[pos] == '-';
+    if (neg || v[pos] == '+') pos++;
+
+    long long num;
+    size_t end = pos;
+    if (parse_number(v, &end, &num)) {
+        while (isspace((unsigned char)v[end])) end++;
+        if (!v[end]) return neg ? (long long)(0ULL - (unsigned long long)num) : num;
+    }
+
+    if (ctx->depth >= ARITH_MAX_DEPTH) {
+        out_errorf("%s: expression recursion level exceeded\n", name);
+        ctx->err = 1;
+        return 0;
+    }
+
+    ArithProg *sub = arith_compile(v);
+    if (!sub) {
+        ctx->err = 1;
+        return 0;
+    }
+    ctx->depth++;
+    long long r = eval_node(sub, sub->root, ctx);
+    ctx->depth--;
+    arith_free(sub);
+    return r;
+}
+
+static void set_var(const char *name, long long v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", v);
+    setenv(name, buf, 1);
+}
+
+static long long eval_node(ArithProg *p, int i, ArithCtx *ctx) {
+    if (ctx->err) return 0;
+    ArithNode *n = &p->nodes[i];
+    long long x, y;
+
+    switch (n->op) {
+        case A_NUM:
+            return n->num;
+        case A_VAR:
+            return get_var(n->name, ctx);
+
+        case A_NEG:
+        case A_POS:
+        case A_NOT:
+        case A_BNOT:
+            return apply_unary(n->op, eval_node(p, n->a, ctx));
+
+        case A_PREINC:
+        case A_PREDEC:
+        case A_POSTINC:
+        case A_POSTDEC: {
+            x = get_var(n->name, ctx);
+            if (ctx->err) return 0;
+            int inc = (n->op == A_PREINC || n->op == A_POSTINC);
+            y = (long long)((unsigned long long)x + (inc ? 1ULL : -1ULL));
+            set_var(n->name, y);
+            return (n->op == A_PREINC || n->op == A_PREDEC) ? y : x;
+        }
+
+        // правая часть && и || вычисляется только при необходимости
+        case A_LAND:
+            if (!eval_node(p, n->a, ctx)) return 0;
+            return eval_node(p, n->b, ctx) != 0;
+        case A_LOR:
+            if (eval_node(p, n->a, ctx)) return 1;
+            return eval_node(p, n->b, ctx) != 0;
+
+        case A_COND:
+            x = eval_node(p, n->a, ctx);
+            return eval_node(p, x ? n->b : n->c, ctx);
+
+        case A_ASSIGN:
+            y = eval_node(p, n->a, ctx);
+            if (n->aop != A_NUM) {
+                x = get_var(n->name, ctx);
+                if (ctx->err) return 0;
+                y = apply_binary(n->aop, x, y, &ctx->err);
+            }
+            if (ctx->err) return 0;
+            set_var(n->name, y);
+            return y;
+
+        default:
+            x = eval_node(p, n->a, ctx);
+            y = eval_node(p, n->b, ctx);
+            if (ctx->err) return 0;
+            return apply_binary(n->op, x, y, &ctx->err);
+    }
+}
+
+// 0 - успех, результат в *out
+int arith_eval(ArithProg *p, long long *out) {
+    ArithCtx ctx = { 0, 0 };
+    long long v = eval_node(p, p->root, &ctx);
+    if (ctx.err) return 1;
+    *out = v;
+    return 0;
+}
+
+
+// ---------- кэш ----------
+
+static struct {
+    char *text;
+    ArithProg *prog;
+} cache[ARITH_CACHE_SIZE];
+
+static unsigned long hash_text(const char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+int arith_expand(const char *expr, long long *out) {
+    unsigned long h = hash_text(expr) % ARITH_CACHE_SIZE;
+
+    if (!cache[h].text || strcmp(cache[h].text, expr) != 0) {
+        ArithProg *p = arith_compile(expr);
+        if (!p) return 1;
+
+        char *text = strdup(expr);
+        if (!text) {
+            arith_free(p);
+            return 1;
+        }
+
+        free(cache[h].text);
+        arith_free(cache[h].prog);
+        cache[h].text = text;
+        cache[h].prog = p;
+    }
+
+    return arith_eval(cache[h].prog, out);
+}
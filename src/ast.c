@@ -1,7 +1,10 @@
 #include "../inc/ast.h"
+#include "../inc/arith.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 ASTNode *create_node(NodeType type){
     ASTNode *node = malloc(sizeof(ASTNode));
@@ -26,6 +29,8 @@ ASTNode *create_command(char** argv, Redirection *redir, int argc){
     node -> command.argc = argc;
     node -> command.argv = argv;
     node -> command.redir = redir;
+    node -> command.pure = 0;
+    compile_redir_plan(redir, &node -> command.plan);
 
 
     return node;
@@ -42,6 +47,7 @@ ASTNode *create_binary(NodeType type, ASTNode *left, ASTNode *right){
 
     node -> binary.left = left;
     node -> binary.right = right;
+    node -> binary.pipe_size = 0;
 
     return node;
 }
@@ -56,12 +62,37 @@ ASTNode *create_unary(NodeType type, ASTNode *child){
     }
 
     node -> unary.child = child;
+    node -> unary.redir = NULL;
+    compile_redir_plan(NULL, &node -> unary.plan);
 
     return node;
 }
 
+void set_unary_redir(ASTNode *node, Redirection *redir){
+    free_redir(node -> unary.redir);
+    free_redir_plan(&node -> unary.plan);
+    node -> unary.redir = redir;
+    compile_redir_plan(redir, &node -> unary.plan);
+}
 
-void add_redir(Redirection **head, RedirType rtype, const char *file){
+ASTNode *create_arith(const char *expr){
+    ASTNode *node = create_node(NODE_ARITH);
+    if(!node) return NULL;
+
+    node -> arith.expr = strdup(expr);
+    node -> arith.prog = NULL;
+    if(!node -> arith.expr){
+        perror("malloc error");
+        free(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+
+// fd < 0 - дескриптор по умолчанию для этого типа
+void add_redir(Redirection **head, RedirType rtype, int fd, const char *file){
 
     Redirection *redir = malloc(sizeof(Redirection));
     if (!redir) return;
@@ -69,6 +100,27 @@ void add_redir(Redirection **head, RedirType rtype, const char *file){
     redir -> type = rtype;
     redir -> filename = strdup(file);
     redir -> next = NULL;
+    redir -> src_fd = -1;
+    redir -> open_flags = 0;
+    redir -> expand = 0;
+    redir -> multios = MULTIOS_NONE;
+
+    switch (rtype) {
+        case REDIR_IN:         redir -> open_flags = O_RDONLY; break;
+        case REDIR_RDWR:       redir -> open_flags = O_RDWR | O_CREAT; break;
+        case REDIR_OUT:
+        case REDIR_ERR_OUT:    redir -> open_flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+        case REDIR_APPEND:
+        case REDIR_ERR_APPEND: redir -> open_flags = O_WRONLY | O_CREAT | O_APPEND; break;
+        case REDIR_DUP:        redir -> src_fd = atoi(file); break;
+        case REDIR_CLOSE:      break;
+        case REDIR_HEREDOC:    break;
+    }
+
+    if (fd < 0) {
+        fd = (rtype == REDIR_IN || rtype == REDIR_RDWR || rtype == REDIR_HEREDOC) ? 0 : 1;
+    }
+    redir -> fd = fd;
 
 
     // no comment
@@ -82,6 +134,54 @@ void add_redir(Redirection **head, RedirType rtype, const char *file){
 
 }
 
+static void plan_touch(RedirPlan *plan, int fd, int *cap){
+    for (int i = 0; i < plan -> n_touched; ++i) {
+        if (plan -> touched[i] == fd) return;
+    }
+    if (plan -> n_touched >= *cap) {
+        *cap = *cap ? *cap * 2 : 4;
+        int *t = realloc(plan -> touched, sizeof(int) * *cap);
+        if (!t) return;
+        plan -> touched = t;
+    }
+    plan -> touched[plan -> n_touched++] = fd;
+}
+
+// собираем, какие дескрипторы меняет список перенаправлений
+void compile_redir_plan(Redirection *redir, RedirPlan *plan){
+    int cap = 0;
+    plan -> n_redirs = 0;
+    plan -> n_touched = 0;
+    plan -> touched = NULL;
+
+    for (Redirection *r = redir; r; r = r -> next) {
+        plan -> n_redirs++;
+        plan_touch(plan, r -> fd, &cap);
+        if (r -> type == REDIR_ERR_OUT || r -> type == REDIR_ERR_APPEND) {
+            plan_touch(plan, STDERR_FILENO, &cap);
+        }
+    }
+
+    // несколько > и >> в один дескриптор - группа multios, а не "последний победил"
+    for (Redirection *r = redir; r; r = r -> next) {
+        if ((r -> type != REDIR_OUT && r -> type != REDIR_APPEND) || r -> multios != MULTIOS_NONE) continue;
+
+        for (Redirection *m = r -> next; m; m = m -> next) {
+            if ((m -> type == REDIR_OUT || m -> type == REDIR_APPEND) && m -> fd == r -> fd) {
+                r -> multios = MULTIOS_LEADER;
+                m -> multios = MULTIOS_MEMBER;
+            }
+        }
+    }
+}
+
+void free_redir_plan(RedirPlan *plan){
+    free(plan -> touched);
+    plan -> touched = NULL;
+    plan -> n_touched = 0;
+    plan -> n_redirs = 0;
+}
+
 
 //Вспомогательная для освобождение дерева
 
@@ -106,6 +206,7 @@ void free_ast(ASTNode *node){
             }
             free(node -> command.argv);
             free_redir(node -> command.redir);
+            free_redir_plan(&node -> command.plan);
             break;
 
         case NODE_PIPE:        
@@ -120,7 +221,13 @@ void free_ast(ASTNode *node){
         case NODE_BACKGROUND:  // &
         case NODE_GROUP:  
             free_ast(node -> unary.child);
+            free_redir(node -> unary.redir);
+            free_redir_plan(&node -> unary.plan);
             break;     // {}
+        case NODE_ARITH:
+            free(node -> arith.expr);
+            arith_free(node -> arith.prog);
+            break;
     }
 
     free(node);
@@ -128,6 +235,37 @@ void free_ast(ASTNode *node){
 
 }
 
+static int walk(ASTNode *node, AstVisitor visit, void *arg, int depth) {
+    if (!node) return 0;
+
+    int rc = visit(node, depth, arg);
+    if (rc) return rc;
+
+    switch (node -> type) {
+        case NODE_PIPE:
+        case NODE_PIPE_STDERR:
+        case NODE_SEQUENCE:
+        case NODE_AND:
+        case NODE_OR:
+            rc = walk(node -> binary.left, visit, arg, depth + 1);
+            if (rc) return rc;
+            return walk(node -> binary.right, visit, arg, depth + 1);
+        case NODE_SUB:
+        case NODE_BACKGROUND:
+        case NODE_GROUP:
+            return walk(node -> unary.child, visit, arg, depth + 1);
+        case NODE_COMMAND:
+        case NODE_ARITH:
+            break;
+    }
+    return 0;
+}
+
+// обход дерева в прямом порядке; ненулевой ответ visit останавливает обход и возвращается
+int ast_walk(ASTNode *node, AstVisitor visit, void *arg) {
+    return walk(node, visit, arg, 0);
+}
+
 const char *get_node_name(NodeType type) {
     switch (type) {
         case NODE_COMMAND:    return "COMMAND";
@@ -138,6 +276,7 @@ const char *get_node_name(NodeType type) {
         case NODE_BACKGROUND: return "BACK";
         case NODE_SUB:        return "SUBSHELL";
         case NODE_GROUP:      return "GROUP";
+        case NODE_ARITH:      return "ARITH";
         default:              return "UNKNOWN";
     }
 }
@@ -149,6 +288,10 @@ const char *get_redir_name(RedirType rt) {
         case REDIR_APPEND:      return ">>";
         case REDIR_ERR_OUT:     return "&>";
         case REDIR_ERR_APPEND:  return "&>>";
+        case REDIR_RDWR:        return "<>";
+        case REDIR_DUP:         return ">&";
+        case REDIR_CLOSE:       return ">&";
+        case REDIR_HEREDOC:     return "<<";
         default:                return "?";
     }
 }
@@ -175,7 +318,14 @@ void print_tree(ASTNode *node, int level) {
             printf("]");
             
             for (Redirection *redir = node->command.redir; redir; redir = redir->next) {
-                printf(" %s %s", get_redir_name(redir->type), redir->filename);
+                int def_fd = (redir->type == REDIR_IN || redir->type == REDIR_RDWR ||
+                              redir->type == REDIR_HEREDOC) ? 0 : 1;
+                if (redir->fd != def_fd) printf(" %d", redir->fd);
+                if (redir->type == REDIR_HEREDOC) {
+                    printf(" << (%zu bytes)", strlen(redir->filename));
+                } else {
+                    printf(" %s %s", get_redir_name(redir->type), redir->filename);
+                }
             }
             printf("\n");
             break;
@@ -185,6 +335,7 @@ void print_tree(ASTNode *node, int level) {
         case NODE_AND:
         case NODE_PIPE_STDERR:
         case NODE_OR:
+            if (node->binary.pipe_size) printf(" (pipesize %d)", node->binary.pipe_size);
             printf("\n");
             print_tree(node->binary.left, level + 1);
             print_tree(node->binary.right, level + 1);
@@ -193,9 +344,16 @@ void print_tree(ASTNode *node, int level) {
         case NODE_BACKGROUND:
         case NODE_SUB:
         case NODE_GROUP:
+            for (Redirection *redir = node->unary.redir; redir; redir = redir->next) {
+                printf(" %s %s", get_redir_name(redir->type), redir->filename);
+            }
             printf("\n");
             print_tree(node->unary.child, level + 1);
             break;
+
+        case NODE_ARITH:
+            printf(" ((%s))\n", node->arith.expr);
+            break;
     }
 }
 
@@ -204,3 +362,148 @@ void print_ast(ASTNode *node) {
     print_tree(node, 0);
     printf("=== END ===\n");
 }
+
+// ---------- дерево обратно в текст (строка задания для jobs) ----------
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} TextBuf;
+
+static void text_put(TextBuf *tb, const char *s, size_t n) {
+    if (tb->failed) return;
+    if (tb->len + n + 1 > tb->cap) {
+        size_t cap = tb->cap ? tb->cap : 64;
+        while (tb->len + n + 1 > cap) cap *= 2;
+        char *tmp = realloc(tb->data, cap);
+        if (!tmp) {
+            tb->failed = 1;
+            return;
+        }
+        tb->data = tmp;
+        tb->cap = cap;
+    }
+    memcpy(tb->data + tb->len, s, n);
+    tb->len += n;
+    tb->data[tb->len] = '\0';
+}
+
+static void text_puts(TextBuf *tb, const char *s) {
+    text_put(tb, s, strlen(s));
+}
+
+// слово без служебных байт лексера
+static void text_word(TextBuf *tb, const char *w) {
+    for (; *w; ++w) {
+        if (*w == '\001' || *w == '\002' || *w == '\003') continue;
+        text_put(tb, w, 1);
+    }
+}
+
+static void text_redir(TextBuf *tb, Redirection *r) {
+    char num[32];
+    int def_fd = (r->type == REDIR_IN || r->type == REDIR_RDWR || r->type == REDIR_HEREDOC) ? 0 : 1;
+
+    text_puts(tb, " ");
+    if (r->fd != def_fd && r->type != REDIR_ERR_OUT && r->type != REDIR_ERR_APPEND) {
+        snprintf(num, sizeof(num), "%d", r->fd);
+        text_puts(tb, num);
+    }
+
+    switch (r->type) {
+        case REDIR_DUP:
+            snprintf(num, sizeof(num), ">&%d", r->src_fd);
+            text_puts(tb, num);
+            return;
+        case REDIR_CLOSE:
+            text_puts(tb, ">&-");
+            return;
+        case REDIR_HEREDOC:
+            // тело уже прочитано, разделитель не хранится
+            if (r->expand == HEREDOC_EXPAND_WORD) {
+                text_puts(tb, "<<< ");
+                text_word(tb, r->filename);
+            } else {
+                text_puts(tb, "<<...");
+            }
+            return;
+        default:
+            text_puts(tb, get_redir_name(r->type));
+            text_word(tb, r->filename);
+            return;
+    }
+}
+
+static void text_node(TextBuf *tb, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_COMMAND:
+            for (int i = 0; i < node->command.argc; i++) {
+                if (i) text_puts(tb, " ");
+                text_word(tb, node->command.argv[i]);
+            }
+            for (Redirection *r = node->command.redir; r; r = r->next) text_redir(tb, r);
+            break;
+
+        case NODE_PIPE:
+        case NODE_PIPE_STDERR:
+        case NODE_SEQUENCE:
+        case NODE_AND:
+        case NODE_OR: {
+            const char *op = node->type == NODE_PIPE        ? " | "
+                           : node->type == NODE_PIPE_STDERR ? " |& "
+                           : node->type == NODE_SEQUENCE    ? "; "
+                           : node->type == NODE_AND         ? " && "
+                                                            : " || ";
+            if (node->binary.pipe_size) {
+                char num[32];
+                snprintf(num, sizeof(num), "pipesize %d ", node->binary.pipe_size);
+                text_puts(tb, num);
+            }
+            text_node(tb, node->binary.left);
+            text_puts(tb, op);
+            text_node(tb, node->binary.right);
+            break;
+        }
+
+        case NODE_BACKGROUND:
+            text_node(tb, node->unary.child);
+            text_puts(tb, " &");
+            break;
+
+        case NODE_SUB:
+            text_puts(tb, "(");
+            text_node(tb, node->unary.child);
+            text_puts(tb, ")");
+            for (Redirection *r = node->unary.redir; r; r = r->next) text_redir(tb, r);
+            break;
+
+        case NODE_GROUP:
+            text_puts(tb, "{ ");
+            text_node(tb, node->unary.child);
+            text_puts(tb, "; }");
+            for (Redirection *r = node->unary.redir; r; r = r->next) text_redir(tb, r);
+            break;
+
+        case NODE_ARITH:
+            text_puts(tb, "((");
+            text_puts(tb, node->arith.expr);
+            text_puts(tb, "))");
+            break;
+    }
+}
+
+// текст команды по дереву, кавычки не восстанавливаются; NULL при нехватке памяти
+char *ast_to_string(ASTNode *node) {
+    TextBuf tb = { NULL, 0, 0, 0 };
+    text_puts(&tb, "");
+    text_node(&tb, node);
+    if (tb.failed) {
+        free(tb.data);
+        return NULL;
+    }
+    return tb.data;
+}
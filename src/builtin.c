@@ -1,15 +1,26 @@
 #include "../inc/builtin.h"
 #include "../inc/execution.h"
 #include "../inc/jobs.h"
+#include "../inc/options.h"
+#include "../inc/history.h"
+#include "../inc/outbuf.h"
+#include "../inc/rlimits.h"
+#include "../inc/shell.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 
-extern Job *first_job;
 extern pid_t shell_pgid;              
 extern int shell_terminal;
+extern int shell_is_interactive;
+
+#define TIMEOUT_KILL_AFTER 10 // TERM не помог за столько секунд - шлем KILL
 
 
 const char *job_status_str(JobStatus st) {
@@ -21,39 +32,79 @@ const char *job_status_str(JobStatus st) {
     }
 }
 
-void print_jobs_list() {
-    Job *job = first_job;
+// full - jobs -l: еще ограничения задания
+void print_jobs_list(int full) {
+    Job *job = g_sh->first_job;
     while (job) {
-        printf("[%d] %d %s %s\n", job->id, job->pgid, 
-               job_status_str(job->status), job->command);
+        char limits[128] = "";
+        if (full && job->limits.set) limits_format(&job->limits, limits, sizeof(limits));
+
+        out_printf(STDOUT_FILENO, "[%d] %d %s %s%s%s\n", job->id, job->pgid,
+                   job_status_str(job->status), job->command,
+                   limits[0] ? "  limit" : "", limits);
         job = job->next;
     }
 }
 
+// таблица встроенных команд
+static const Builtin builtins[] = {
+    { "cd",       builtin_cd,       0 },
+    { "exit",     builtin_exit,     0 },
+    { "pwd",      builtin_pwd,      BUILTIN_NOFORK },
+    { "echo",     builtin_echo,     BUILTIN_NOFORK },
+    { "help",     builtin_help,     BUILTIN_NOFORK },
+    { "jobs",     builtin_jobs,     BUILTIN_NOFORK },
+    { "history",  builtin_history,  BUILTIN_NOFORK },
+    { "fg",       builtin_fg,       0 },
+    { "bg",       builtin_bg,       0 },
+    { "kill",     builtin_kill,     0 },
+    { "wait",     builtin_wait,     0 },
+    { "timeout",  builtin_timeout,  BUILTIN_UTIL },
+    { "limit",    builtin_limit,    0 },
+    { "affinity", builtin_affinity, 0 },
+    { "set",      builtin_set,      0 },
+    { "unset",    builtin_unset,    0 },
+    { "true",     builtin_true,     BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "false",    builtin_false,    BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "cat",      builtin_cat,      BUILTIN_UTIL },
+    { "test",     builtin_test,     BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "[",        builtin_test,     BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "printf",   builtin_printf,   BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "basename", builtin_basename, BUILTIN_UTIL | BUILTIN_NOFORK },
+    { "dirname",  builtin_dirname,  BUILTIN_UTIL | BUILTIN_NOFORK },
+};
+
+const Builtin *find_builtin(const char *s) {
+    if (!s) return NULL;
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+        if (strcmp(s, builtins[i].name) != 0) continue;
+
+        // утилиты можно отключить ради строгой совместимости
+        if ((builtins[i].flags & BUILTIN_UTIL) && !get_option(OPT_BUILTIN_UTILS)) return NULL;
+        return &builtins[i];
+    }
+    return NULL;
+}
+
+// вся таблица, включая отключенные утилиты (для дополнения)
+const Builtin *builtin_list(size_t *n) {
+    *n = sizeof(builtins) / sizeof(builtins[0]);
+    return builtins;
+}
+
 int is_builtin(const char *s) {
-    if (!s) return 0;
-    return strcmp(s, "cd") == 0 ||
-           strcmp(s, "exit") == 0 ||
-           strcmp(s, "pwd") == 0 ||
-           strcmp(s, "echo") == 0 ||
-           strcmp(s, "help") == 0 ||
-           strcmp(s, "jobs") == 0 ||
-           strcmp(s, "fg") == 0 ||
-           strcmp(s, "bg") == 0 ||
-           strcmp(s, "kill") == 0 ||
-           strcmp(s, "set") == 0 ||
-           strcmp(s, "unset") == 0;
+    return find_builtin(s) != NULL;
 }     
 
 int builtin_cd(char **argv) {
     // argv[0] = "cd", argv[1] = путь (или NULL)
     const char *path = argv[1] ? argv[1] : getenv("HOME");
     if (!path) {
-        fprintf(stderr, "cd: HOME not set\n");
+        out_errorf("cd: HOME not set\n");
         return 1;
     }
     if (chdir(path) != 0) {
-        perror("cd");
+        out_perror("cd");
         return 1;
     }
     return 0;
@@ -62,14 +113,22 @@ int builtin_cd(char **argv) {
 int builtin_exit(char **argv) {
     // argv[1] может содержать код выхода
     int code = argv[1] ? atoi(argv[1]) : 0;
-    exit(code);
+    out_flush_all();
+    // в дочернем процессе (подоболочка, стадия конвейера) - просто выходим;
+    // сам шелл может быть библиотекой внутри чужой программы, он только
+    // прекращает выполнение, а процесс завершает main() бинарника
+    if (getpid() != shell_pid) exit(code);
+    g_sh->exited = 1;
+    g_sh->last_status = code;
+    return code;
 }
 
 int builtin_echo(char **argv) {
     for (int i = 1; argv[i]; ++i) {
-        printf("%s%s", argv[i], argv[i + 1] ? " " : "");
+        out_puts(STDOUT_FILENO, argv[i]);
+        if (argv[i + 1]) out_putc(STDOUT_FILENO, ' ');
     }
-    printf("\n");
+    out_putc(STDOUT_FILENO, '\n');
     return 0;
 }
 
@@ -77,9 +136,9 @@ int builtin_pwd(char **argv) {
     (void)argv;
     char cwd[1024];
     if (getcwd(cwd, sizeof(cwd))) {
-        printf("%s\n", cwd);
+        out_printf(STDOUT_FILENO, "%s\n", cwd);
     } else {
-        perror("getcwd");
+        out_perror("getcwd");
         return 1;
     }
     return 0;
@@ -87,24 +146,85 @@ int builtin_pwd(char **argv) {
 
 int builtin_help(char **argv) {
     (void)argv;
-    printf("MyBash builtins:\n");
-    printf("  cd [dir]          - Change directory\n");
-    printf("  pwd               - Print working directory\n");
-    printf("  echo [args...]    - Print arguments\n");
-    printf("  exit [n]          - Exit shell with code n\n");
-    printf("  help              - Show this help\n");
-    printf("  jobs              - List background jobs\n");
-    printf("  fg %%jobid         - Move job to foreground\n");
-    printf("  bg %%jobid         - Continue job in background\n");
-    printf("  kill [-SIG] <pid> - Send signal to process\n");
-    printf("  set VAR=value     - Set environment variable\n");
-    printf("  unset VAR         - Unset environment variable\n");
+    static const char help_text[] =
+        "MyBash builtins:\n"
+        "  cd [dir]          - Change directory\n"
+        "  pwd               - Print working directory\n"
+        "  echo [args...]    - Print arguments\n"
+        "  exit [n]          - Exit shell with code n\n"
+        "  help              - Show this help\n"
+        "  jobs [-l]         - List background jobs (-l: with their limits)\n"
+        "  history [n]       - Show command history (the last n entries)\n"
+        "  history -g text   - Show history entries containing text\n"
+        "  fg %jobid         - Move job to foreground\n"
+        "  bg %jobid         - Continue job in background\n"
+        "  kill [-SIG] <pid> - Send signal to process\n"
+        "  wait [-n] [%job|pid...] - Wait for jobs (-n: for the first one to finish)\n"
+        "  set VAR=value     - Set environment variable\n"
+        "  unset VAR         - Unset environment variable\n"
+        "  set -o|+o option  - Enable/disable shell option (set -o lists them)\n"
+        "Utilities (set +o builtin-utils to use external ones):\n"
+        "  true, false, cat, test, [, printf, basename, dirname,\n"
+        "  timeout [-s SIG] [-k DUR] DUR cmd - TERM, then KILL the command's group\n"
+        "  limit [-m SIZE] [-t SEC] [-n NICE] [-io CLASS] [-c CPUS] cmd - Run cmd with resource limits\n"
+        "  affinity CPUS cmd - Run cmd on the given cores (0-3,6)\n";
+    out_write(STDOUT_FILENO, help_text, sizeof(help_text) - 1);
     return 0;
 }
 
 int builtin_jobs(char **argv) {
-    (void)argv;
-    print_jobs_list();
+    int full = argv[1] && strcmp(argv[1], "-l") == 0;
+    print_jobs_list(full);
+    return 0;
+}
+
+static void print_history_entry(size_t i) {
+    size_t len;
+    const char *s = history_entry(i, &len);
+    out_printf(STDOUT_FILENO, "%5zu  ", i + 1);
+    out_write(STDOUT_FILENO, s, len);
+    out_putc(STDOUT_FILENO, '\n');
+}
+
+int builtin_history(char **argv) {
+    size_t n = history_count();
+
+    // history -g TEXT: записи с подстрокой, через индекс, от старых к новым
+    if (argv[1] && strcmp(argv[1], "-g") == 0) {
+        if (!argv[2] || argv[3]) {
+            out_errorf("history: usage: history -g text\n");
+            return 1;
+        }
+        size_t cnt = 0, cap = 0, *found = NULL;
+        for (size_t i = history_search(argv[2], n); i != HISTORY_NONE; i = history_search(argv[2], i)) {
+            if (cnt == cap) {
+                cap = cap ? cap * 2 : 256;
+                size_t *p = realloc(found, sizeof(size_t) * cap);
+                if (!p) {
+                    free(found);
+                    out_perror("history");
+                    return 1;
+                }
+                found = p;
+            }
+            found[cnt++] = i;
+        }
+        while (cnt-- > 0) print_history_entry(found[cnt]);
+        free(found);
+        return 0;
+    }
+
+    size_t from = 0;
+    if (argv[1]) {
+        char *end;
+        long k = strtol(argv[1], &end, 10);
+        if (*end || k < 0 || argv[2]) {
+            out_errorf("history: usage: history [n] | history -g text\n");
+            return 1;
+        }
+        if ((size_t)k < n) from = n - k;
+    }
+    for (size_t i = from; i < n; ++i) print_history_entry(i);
     return 0;
 }
 
@@ -116,7 +236,7 @@ int builtin_kill(char **argv) {
 
     // Проверка на наличие аргументов
     if (!argv[1]) {
-        fprintf(stderr, "kill: usage: kill [-SIGNAL] <pid|%%jobid>\n");
+        out_errorf("kill: usage: kill [-SIGNAL] <pid|%%jobid>\n");
         return 1;
     }
 
@@ -124,7 +244,7 @@ int builtin_kill(char **argv) {
     if (argv[1][0] == '-' && argv[1][1] != '\0') {
         sig = atoi(argv[1] + 1);
         if (sig <= 0) {
-            fprintf(stderr, "kill: bad signal: %s\n", argv[1]);
+            out_errorf("kill: bad signal: %s\n", argv[1]);
             return 1;
         }
         idx = 2;
@@ -132,7 +252,7 @@ int builtin_kill(char **argv) {
 
     // Проверка на наличие PID
     if (!argv[idx]) {
-        fprintf(stderr, "kill: usage: kill [-SIGNAL] <pid|%%jobid>\n");
+        out_errorf("kill: usage: kill [-SIGNAL] <pid|%%jobid>\n");
         return 1;
     }
 
@@ -143,13 +263,13 @@ int builtin_kill(char **argv) {
         Job *j = find_job_by_id(job_id);
         
         if (!j) {
-            fprintf(stderr, "kill: job not found: %s\n", argv[idx]);
+            out_errorf("kill: job not found: %s\n", argv[idx]);
             return 1;
         }
 
         //когда указываем отрицательный pgid, то убиваем весь конвеер(при его наличии)
         if (kill(-j->pgid, sig) != 0) {
-            perror("kill");
+            out_perror("kill");
             return 1;
         }
         return 0;
@@ -157,27 +277,40 @@ int builtin_kill(char **argv) {
 
     pid_t pid = (pid_t)atoi(argv[idx]);
     if (pid <= 0) {
-        fprintf(stderr, "kill: bad pid: %s\n", argv[idx]);
+        out_errorf("kill: bad pid: %s\n", argv[idx]);
         return 1;
     }
     if (kill(pid, sig) != 0) {
-        perror("kill");
+        out_perror("kill");
         return 1;
     }
     return 0;
 }
 
 int builtin_set(char **argv) {
-    // set VAR=value
+    // set VAR=value | set -o [option] | set +o option
     if (!argv[1]) {
-        fprintf(stderr, "set: usage: set VAR=value\n");
+        out_errorf("set: usage: set VAR=value | set -o|+o option\n");
         return 1;
     }
 
+    if (strcmp(argv[1], "-o") == 0 || strcmp(argv[1], "+o") == 0) {
+        int enable = argv[1][0] == '-';
+        if (!argv[2]) {
+            print_options();
+            return 0;
+        }
+        int rc = 0;
+        for (int i = 2; argv[i]; ++i) {
+            if (set_option(argv[i], enable) != 0) rc = 1;
+        }
+        return rc;
+    }
+
     char *eq = strchr(argv[1], '=');
 
     if (!eq || eq == argv[1]) {
-        fprintf(stderr, "set: usage: set VAR=value\n");
+        out_errorf("set: usage: set VAR=value\n");
         return 1;
     }
 
@@ -190,7 +323,7 @@ int builtin_set(char **argv) {
     *eq = '=';
 
     if (rc != 0) {
-        perror("setenv");
+        out_perror("setenv");
         return 1;
     }
     return 0;
@@ -198,84 +331,78 @@ int builtin_set(char **argv) {
 
 int builtin_unset(char **argv) {
     if (!argv[1]) {
-        fprintf(stderr, "unset: usage: unset VAR\n");
+        out_errorf("unset: usage: unset VAR\n");
         return 1;
     }
     if (unsetenv(argv[1]) != 0) {
-        perror("unsetenv");
+        out_perror("unsetenv");
         return 1;
     }
     return 0;
 }
 
 int run_builtin(char **argv) {
-    if (strcmp(argv[0], "cd") == 0)     return builtin_cd(argv);
-    if (strcmp(argv[0], "exit") == 0)   return builtin_exit(argv);
-    if (strcmp(argv[0], "pwd") == 0)    return builtin_pwd(argv);
-    if (strcmp(argv[0], "echo") == 0)   return builtin_echo(argv);
-    if (strcmp(argv[0], "help") == 0)   return builtin_help(argv);
-    if (strcmp(argv[0], "jobs") == 0)   return builtin_jobs(argv);
-    if (strcmp(argv[0], "fg") == 0)     return builtin_fg(argv);
-    if (strcmp(argv[0], "bg") == 0)     return builtin_bg(argv);
-    if (strcmp(argv[0], "kill") == 0)   return builtin_kill(argv);
-    if (strcmp(argv[0], "set") == 0)    return builtin_set(argv);
-    if (strcmp(argv[0], "unset") == 0)  return builtin_unset(argv);
-    
-    return 1;  // Неизвестная команда
+    const Builtin *b = find_builtin(argv[0]);
+    if (!b) return 1;  // Неизвестная команда
+
+    // кэш stat для test живет только пока подряд идут проверки
+    if (b->fn != builtin_test) test_cache_reset();
+
+    return b->fn(argv);
 }
 
 int run_builtin_with_redir(ASTNode *node) {
-    // Сохраняем оригинальные дескрипторы
-    int saved_in = dup(STDIN_FILENO);
-    int saved_out = dup(STDOUT_FILENO);
-    int saved_err = dup(STDERR_FILENO);
-    
-    if (saved_in < 0 || saved_out < 0 || saved_err < 0) {
-        perror("dup");
+    RedirPlan *plan = &node->command.plan;
+
+    // без перенаправлений ничего не сохраняем - ни одного лишнего системного вызова
+    if (plan->n_redirs == 0) {
+        return run_builtin(node->command.argv);
+    }
+
+    // всё накопленное относится к старому stdout
+    out_flush_all();
+
+    // Сохраняем только те дескрипторы, которые меняет план
+    int saved[plan->n_touched];
+    if (save_redir_fds(plan, saved) != 0) {
         return 1;
     }
 
     // Применяем перенаправления
     if (handle_redirection(node->command.redir) != 0) {
-        dup2(saved_in, STDIN_FILENO);
-        dup2(saved_out, STDOUT_FILENO);
-        dup2(saved_err, STDERR_FILENO);
-        close(saved_in);
-        close(saved_out);
-        close(saved_err);
+        restore_redir_fds(plan, saved);
         return 1;
     }
 
     // Выполняем встроенную команду
     int rc = run_builtin(node->command.argv);
 
+    // дописываем вывод в перенаправленный файл, пока он еще на месте
+    out_flush_all();
+
     // Восстанавливаем оригинальные дескрипторы
-    dup2(saved_in, STDIN_FILENO);
-    dup2(saved_out, STDOUT_FILENO);
-    dup2(saved_err, STDERR_FILENO);
-    close(saved_in);
-    close(saved_out);
-    close(saved_err);
+    restore_redir_fds(plan, saved);
     
     return rc;
 }
 
 int builtin_fg(char **args) {
     if (!args[1]) {
-        fprintf(stderr, "fg: usage: fg <job_id>\n");
+        out_errorf("fg: usage: fg <job_id>\n");
         return 1;
     }
     
     int job_id = atoi(args[1]); 
     Job *jobs_list = find_job_by_id(job_id);
     if (!jobs_list) {
-        fprintf(stderr, "fg: job not found: %s\n", args[1]);
+        out_errorf("fg: job not found: %s\n", args[1]);
         return 1;
     }
 
     jobs_list -> is_background = 0;
 
-    tcsetpgrp(shell_terminal, jobs_list->pgid);
+    out_flush_all();
+    terminal_to_job(jobs_list);
 
 
     if (jobs_list->status == JOB_STOPPED) {
@@ -284,30 +411,360 @@ int builtin_fg(char **args) {
     }
 
 
+    pid_t pgid = jobs_list->pgid; // wait_for_job удаляет завершившееся задание
     wait_for_job(jobs_list);
 
    
-    tcsetpgrp(shell_terminal, shell_pgid);
+    terminal_to_shell(pgid);
     return 0;
 }
 
 int builtin_bg(char **args) {
     if (!args[1]) {
-        fprintf(stderr, "bg: usage: bg <job_id>\n");
+        out_errorf("bg: usage: bg <job_id>\n");
         return 1;
     }
 
     int job_id = atoi(args[1]);
     Job *jobs_list = find_job_by_id(job_id);
     if (!jobs_list) {
-        fprintf(stderr, "bg: job not found\n");
+        out_errorf("bg: job not found\n");
         return 1;
     }
 
     if (jobs_list -> status == JOB_STOPPED) {
         kill(-jobs_list->pgid, SIGCONT);
         jobs_list -> status = JOB_RUNNING;
-        printf("[%d]+ %s &\n", jobs_list -> id, jobs_list -> command);
+        out_printf(STDOUT_FILENO, "[%d]+ %s &\n", jobs_list -> id, jobs_list -> command);
     }
     return 0;
 }
+
+// ---------- wait и timeout ----------
+
+// задание по пиду любого его процесса
+static Job *find_job_by_pid(pid_t pid) {
+    for (Job *j = g_sh->first_job; j; j = j->next) {
+        if (j->pgid == pid) return j;
+        for (Process *p = j->first_process; p; p = p->next) {
+            if (p->pid == pid) return j;
+        }
+    }
+    return NULL;
+}
+
+// собираем оставшихся в группе (помощников) и удаляем задание
+static void finish_job(Job *job) {
+    while (waitpid(-job->pgid, NULL, WNOHANG) > 0);
+    delete_job(job->pgid);
+}
+
+int builtin_wait(char **argv) {
+    // wait [-n] [%jobid|pid ...]
+    int any = 0, i = 1;
+    if (argv[1] && strcmp(argv[1], "-n") == 0) {
+        any = 1;
+        i = 2;
+    }
+
+    int cap = 8, n = 0, missing = 0;
+    Job **jobs = malloc(sizeof(Job *) * cap);
+    if (!jobs) {
+        out_perror("malloc");
+        return 1;
+    }
+
+    // без аргументов - все фоновые задания
+    int all = !argv[i];
+    Job *j = all ? g_sh->first_job : NULL;
+
+    while (all ? j != NULL : argv[i] != NULL) {
+        Job *job = j;
+        if (all) {
+            j = j->next;
+            if (!job->is_background || !job->first_process) continue;
+        } else {
+            const char *arg = argv[i++];
+            job = arg[0] == '%' ? find_job_by_id(atoi(arg + 1)) : find_job_by_pid((pid_t)atoi(arg));
+            if (!job || !job->first_process) {
+                out_errorf("wait: %s: no such job\n", arg);
+                missing = 1;
+                continue;
+            }
+        }
+
+        if (n >= cap) {
+            cap *= 2;
+            Job **tmp = realloc(jobs, sizeof(Job *) * cap);
+            if (!tmp) break;
+            jobs = tmp;
+        }
+        jobs[n++] = job;
+    }
+
+    if (n == 0) {
+        free(jobs);
+        return (any || missing) ? 127 : 0;
+    }
+
+    out_flush_all();
+    int r = jobs_wait(jobs, n, any ? JOB_WAIT_ANY : 0, -1);
+
+    int rc = 0;
+    if (any) {
+        if (r >= 0 && r < n) {
+            rc = job_exit_code(jobs[r]);
+            finish_job(jobs[r]);
+        }
+    } else {
+        rc = missing ? 127 : job_exit_code(jobs[n - 1]);
+        for (int k = 0; k < n; ++k) finish_job(jobs[k]);
+    }
+
+    free(jobs);
+    return rc;
+}
+
+// встроенная или внешняя команда в уже созданном дочернем процессе
+static void exec_argv(const char *who, char **cmd) {
+    if (is_builtin(cmd[0])) {
+        int rc = run_builtin(cmd);
+        out_flush_all();
+        if (rc != BUILTIN_DEFER) _exit(rc);
+    }
+    execvp(cmd[0], cmd);
+    out_errorf("%s: %s: command not found\n", who, cmd[0]);
+    _exit(127);
+}
+
+// команда - отдельное задание переднего плана со своей группой; lim применяется перед exec
+// Своя группа у команды - только при управлении заданиями; в -c и скриптах она,
+// как и в execute_command, остается в группе шелла, чтобы до нее доходили
+// Ctrl-C и killpg вызывающего. Тогда сигнал шлем только ей самой.
+static void signal_spawned(pid_t pid, int sig) {
+    kill(shell_is_interactive ? -pid : pid, sig);
+}
+
+static Job *spawn_job(const char *who, char **cmd, const JobLimits *lim) {
+    out_flush_all();
+    pid_t pid = fork();
+    if (pid < 0) {
+        out_perror("fork");
+        return NULL;
+    }
+
+    if (pid == 0) {
+        if (shell_is_interactive) {
+            setpgid(0, 0);
+            tcsetpgrp(shell_terminal, getpid());
+
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+        }
+        shell_is_interactive = 0;
+
+        if (limits_apply(lim) != 0) _exit(125);
+        exec_argv(who, cmd);
+    }
+
+    if (shell_is_interactive) setpgid(pid, pid);
+    Job *job = add_job(pid, cmd[0], JOB_RUNNING, 0);
+    job_add_process(job, pid);
+    if (!job || !job->first_process) {
+        signal_spawned(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (job) delete_job(pid);
+        return NULL;
+    }
+    if (shell_is_interactive) tcsetpgrp(shell_terminal, pid);
+    return job;
+}
+
+// r - результат jobs_wait; остановленное задание остается в списке
+static int foreground_done(Job *job, int r) {
+    if (shell_is_interactive) terminal_to_shell(job->pgid);
+
+    int rc = job_exit_code(job);
+    if (r == JOB_WAIT_STOPPED) {
+        job->is_background = 1;
+        printf("\n[%d]+ Stopped %s\n", job->id, job->command);
+        return rc;
+    }
+
+    finish_job(job);
+    return rc;
+}
+
+// длительность: число (можно дробное) с необязательным суффиксом s, m, h, d
+static int parse_duration(const char *s, struct timespec *ts) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return 1;
+
+    switch (*end) {
+        case '\0':
+        case 's': break;
+        case 'm': v *= 60; break;
+        case 'h': v *= 3600; break;
+        case 'd': v *= 86400; break;
+        default: return 1;
+    }
+    if (*end && end[1]) return 1;
+
+    ts->tv_sec = (time_t)v;
+    ts->tv_nsec = (long)((v - (double)ts->tv_sec) * 1e9);
+    return 0;
+}
+
+static int parse_signal(const char *s) {
+    static const struct {
+        const char *name;
+        int sig;
+    } sigs[] = {
+        { "TERM", SIGTERM }, { "KILL", SIGKILL }, { "INT", SIGINT },   { "HUP", SIGHUP },
+        { "QUIT", SIGQUIT }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM },
+    };
+
+    if (isdigit((unsigned char)s[0])) return atoi(s);
+    if (strncmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); ++i) {
+        if (strcmp(s, sigs[i].name) == 0) return sigs[i].sig;
+    }
+    return -1;
+}
+
+static int arm_timer(int fd, const struct timespec *ts) {
+    struct itimerspec it;
+    memset(&it, 0, sizeof(it));
+    it.it_value = *ts;
+    if (it.it_value.tv_sec == 0 && it.it_value.tv_nsec == 0) it.it_value.tv_nsec = 1; // 0 выключает таймер
+    return timerfd_settime(fd, 0, &it, NULL);
+}
+
+// Команда - отдельное задание (со своей группой, если есть управление заданиями);
+// ждем её pidfd вместе с timerfd. По истечении срока сигнал (TERM) группе команды,
+// без управления заданиями - самой команде; еще через -k (по умолчанию 10 с) - KILL.
+int builtin_timeout(char **argv) {
+    int sig = SIGTERM;
+    struct timespec kill_after = { TIMEOUT_KILL_AFTER, 0 };
+    int i = 1;
+
+    while (argv[i] && argv[i][0] == '-' && argv[i][1]) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-s") == 0 && argv[i + 1]) {
+            sig = parse_signal(argv[i + 1]);
+            if (sig <= 0) {
+                out_errorf("timeout: %s: invalid signal\n", argv[i + 1]);
+                return 125;
+            }
+        } else if (strcmp(argv[i], "-k") == 0 && argv[i + 1]) {
+            if (parse_duration(argv[i + 1], &kill_after) != 0) {
+                out_errorf("timeout: invalid time interval '%s'\n", argv[i + 1]);
+                return 125;
+            }
+        } else {
+            return BUILTIN_DEFER; // --foreground, --preserve-status и т.п. - внешний timeout
+        }
+        i += 2;
+    }
+
+    struct timespec duration;
+    if (!argv[i] || !argv[i + 1]) {
+        out_errorf("timeout: usage: timeout [-s SIG] [-k DURATION] DURATION command [args...]\n");
+        return 125;
+    }
+    if (parse_duration(argv[i], &duration) != 0) {
+        out_errorf("timeout: invalid time interval '%s'\n", argv[i]);
+        return 125;
+    }
+    char **cmd = argv + i + 1;
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0) {
+        out_perror("timerfd_create");
+        return 125;
+    }
+
+    Job *job = spawn_job("timeout", cmd, NULL);
+    if (!job) {
+        close(tfd);
+        return 125;
+    }
+    pid_t pid = job->pgid;
+
+    int timed_out = 0, killed = 0;
+    arm_timer(tfd, &duration);
+    int r = jobs_wait(&job, 1, JOB_WAIT_STOP, tfd);
+
+    if (r == JOB_WAIT_TIMEOUT) {
+        timed_out = 1;
+        signal_spawned(pid, sig);
+        signal_spawned(pid, SIGCONT); // остановленная команда иначе не обработает сигнал
+        arm_timer(tfd, &kill_after);
+        r = jobs_wait(&job, 1, JOB_WAIT_STOP, tfd);
+
+        if (r == JOB_WAIT_TIMEOUT) {
+            killed = 1;
+            signal_spawned(pid, SIGKILL);
+            r = jobs_wait(&job, 1, 0, -1);
+        }
+    }
+    close(tfd);
+
+    // после Ctrl+Z срок больше не следим: это обычное остановленное задание
+    int rc = foreground_done(job, r);
+    if (r == JOB_WAIT_STOPPED) return rc;
+    if (killed || (timed_out && sig == SIGKILL)) return 128 + SIGKILL;
+    if (timed_out) return 124;
+    return rc;
+}
+
+// команда с ограничениями lim
+static int run_limited(const char *who, char **cmd, const JobLimits *lim) {
+    // уже в дочернем процессе (конвейер, &, timeout): ограничиваем себя и выполняем команду
+    if (getpid() != shell_pid) {
+        if (limits_apply(lim) != 0) return 125;
+        exec_argv(who, cmd);
+    }
+
+    Job *job = spawn_job(who, cmd, lim);
+    if (!job) return 125;
+    job->limits = *lim;
+
+    int r = jobs_wait(&job, 1, JOB_WAIT_STOP, -1);
+    return foreground_done(job, r);
+}
+
+// limit [-m SIZE] [-t SEC] [-n NICE] [-io CLASS[:N]] [-c CPUS] cmd ...
+int builtin_limit(char **argv) {
+    JobLimits lim;
+    int i = limits_parse(argv, &lim, 1);
+    if (i < 0) return 125;
+    if (!argv[i]) {
+        out_errorf("limit: usage: limit [-m SIZE] [-t SEC] [-n NICE] [-io idle|be[:N]|rt[:N]] [-c CPUS] command [args...]\n");
+        return 125;
+    }
+    return run_limited("limit", argv + i, &lim);
+}
+
+// affinity CPUS cmd ... - то же, что limit -c CPUS, без отдельного taskset на стадию
+int builtin_affinity(char **argv) {
+    JobLimits lim;
+    memset(&lim, 0, sizeof(lim));
+
+    if (!argv[1] || !argv[2]) {
+        out_errorf("affinity: usage: affinity CPUS command [args...]\n");
+        return 125;
+    }
+    if (parse_cpu_list(argv[1], &lim) != 0) {
+        out_errorf("affinity: bad cpu list: %s\n", argv[1]);
+        return 125;
+    }
+    return run_limited("affinity", argv + 2, &lim);
+}
@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+
+#include "../inc/complete.h"
+#include "../inc/builtin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define GETDENTS_BUF (64 * 1024)  // записей каталога за один системный вызов
+#define DIR_CACHE_SIZE 8          // каталогов для имен файлов
+
+// запись getdents64 (в glibc обертка есть не везде)
+typedef struct {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} Dirent64;
+
+typedef struct {
+    char **names;
+    unsigned char *is_dir;
+    size_t n;
+    size_t cap;
+} NameList;
+
+// каталог из PATH: исполняемые файлы и mtime, при котором они прочитаны
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    NameList list;
+} CachedDir;
+
+static char *index_path = NULL;       // PATH, по которой построен индекс
+static CachedDir *path_dirs = NULL;
+static size_t path_ndirs = 0;
+static char **commands = NULL;        // имена из всех каталогов, отсортированы, без повторов
+static size_t ncommands = 0;
+
+static CachedDir dir_cache[DIR_CACHE_SIZE];
+static int dir_cache_len = 0;
+
+static void list_free(NameList *l) {
+    for (size_t i = 0; i < l->n; ++i) free(l->names[i]);
+    free(l->names);
+    free(l->is_dir);
+    memset(l, 0, sizeof(*l));
+}
+
+static int list_add(NameList *l, const char *name, int is_dir) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        char **names = realloc(l->names, sizeof(char *) * cap);
+        if (!names) return 1;
+        l->names = names;
+        unsigned char *d = realloc(l->is_dir, cap);
+        if (!d) return 1;
+        l->is_dir = d;
+        l->cap = cap;
+    }
+    char *copy = strdup(name);
+    if (!copy) return 1;
+    l->names[l->n] = copy;
+    l->is_dir[l->n] = is_dir;
+    l->n++;
+    return 0;
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int same_time(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Читаем каталог пачками getdents64. exec_only - только исполняемые не-каталоги
+// (для PATH): тип берем из d_type, stat делаем лишь для ссылок и неизвестных типов.
+static int read_dir(const char *path, int exec_only, NameList *out) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return 1;
+
+    char *buf = malloc(GETDENTS_BUF);
+    if (!buf) {
+        close(fd);
+        return 1;
+    }
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, GETDENTS_BUF)) > 0) {
+        for (long off = 0; off < n;) {
+            Dirent64 *d = (Dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+            int is_dir = d->d_type == DT_DIR;
+            if (d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, name, &st, 0) != 0) continue;
+                is_dir = S_ISDIR(st.st_mode);
+            }
+            if (exec_only && (is_dir || faccessat(fd, name, X_OK, 0) != 0)) continue;
+
+            if (list_add(out, name, is_dir) != 0) break;
+        }
+    }
+
+    free(buf);
+    close(fd);
+    return n < 0;
+}
+
+// ---- индекс PATH ----
+
+static void merge_commands(void) {
+    size_t total = 0;
+    for (size_t i = 0; i < path_ndirs; ++i) total += path_dirs[i].list.n;
+
+    free(commands);
+    ncommands = 0;
+    commands = malloc(sizeof(char *) * (total ? total : 1));
+    if (!commands) return;
+
+    for (size_t i = 0; i < path_ndirs; ++i) {
+        memcpy(commands + ncommands, path_dirs[i].list.names, sizeof(char *) * path_dirs[i].list.n);
+        ncommands += path_dirs[i].list.n;
+    }
+    qsort(commands, ncommands, sizeof(char *), cmp_str);
+
+    size_t k = 0;
+    for (size_t i = 0; i < ncommands; ++i) {
+        if (k == 0 || strcmp(commands[k - 1], commands[i]) != 0) commands[k++] = commands[i];
+    }
+    ncommands = k;
+}
+
+// Новая PATH: каталоги, которые в ней остались, переезжают в новый список вместе
+// с прочитанным содержимым, остальные освобождаются.
+static int path_split(const char *path) {
+    size_t cnt = 1;
+    for (const char *p = path; *p; ++p) cnt += *p == ':';
+    CachedDir *dirs = calloc(cnt, sizeof(CachedDir));
+    char *copy = strdup(path);
+    if (!dirs || !copy) {
+        free(dirs);
+        free(copy);
+        return 1;
+    }
+
+    size_t n = 0;
+    for (const char *p = path;; ++p) {
+        const char *e = strchrnul(p, ':');
+        // пустой элемент PATH - текущий каталог
+        char *dir = e > p ? strndup(p, e - p) : strdup(".");
+        if (dir) {
+            size_t k = 0;
+            while (k < path_ndirs && !(path_dirs[k].path && strcmp(path_dirs[k].path, dir) == 0)) k++;
+            if (k < path_ndirs) {
+                dirs[n] = path_dirs[k];
+                memset(&path_dirs[k], 0, sizeof(CachedDir));
+                free(dir);
+            } else {
+                dirs[n].path = dir;
+                dirs[n].mtime.tv_sec = -1;
+            }
+            n++;
+        }
+        if (!*e) break;
+        p = e;
+    }
+
+    for (size_t i = 0; i < path_ndirs; ++i) {
+        free(path_dirs[i].path);
+        list_free(&path_dirs[i].list);
+    }
+    free(path_dirs);
+    free(index_path);
+    path_dirs = dirs;
+    path_ndirs = n;
+    index_path = copy;
+    return 0;
+}
+
+// Индекс актуален, пока не сменилась PATH и mtime ее каталогов: на каждое дополнение
+// один stat на каталог, перечитываются только изменившиеся.
+static void path_index_update(void) {
+    const char *path = getenv("PATH");
+    if (!path) path = "";
+
+    // PATH сравниваем каждый раз: ее меняют set, unset и setenv программы с библиотекой
+    int changed = 0;
+    if (!index_path || strcmp(index_path, path) != 0) {
+        if (path_split(path) != 0) return;
+        changed = 1;
+    }
+
+    for (size_t i = 0; i < path_ndirs; ++i) {
+        CachedDir *d = &path_dirs[i];
+        struct stat st;
+        struct timespec mt = { -2, 0 }; // нет каталога
+        if (stat(d->path, &st) == 0) mt = st.st_mtim;
+        if (same_time(mt, d->mtime)) continue;
+
+        list_free(&d->list);
+        if (mt.tv_sec != -2) read_dir(d->path, 1, &d->list);
+        d->mtime = mt;
+        changed = 1;
+    }
+    if (changed || !commands) merge_commands();
+}
+
+// ---- каталоги для имен файлов ----
+
+static NameList *cached_dir(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+
+    for (int i = 0; i < dir_cache_len; ++i) {
+        CachedDir *d = &dir_cache[i];
+        if (strcmp(d->path, path) != 0) continue;
+        if (same_time(d->mtime, st.st_mtim)) return &d->list;
+        list_free(&d->list);
+        d->mtime = st.st_mtim;
+        read_dir(path, 0, &d->list);
+        return &d->list;
+    }
+
+    if (dir_cache_len == DIR_CACHE_SIZE) {
+        free(dir_cache[0].path);
+        list_free(&dir_cache[0].list);
+        memmove(dir_cache, dir_cache + 1, sizeof(CachedDir) * (DIR_CACHE_SIZE - 1));
+        dir_cache_len--;
+    }
+
+    CachedDir *d = &dir_cache[dir_cache_len];
+    memset(d, 0, sizeof(*d));
+    d->path = strdup(path);
+    if (!d->path) return NULL;
+    d->mtime = st.st_mtim;
+    read_dir(path, 0, &d->list);
+    dir_cache_len++;
+    return &d->list;
+}
+
+// ---- сборка вариантов ----
+
+// экранируем обратной косой чертой то, что лексер понял бы иначе
+static char *escape_word(const char *s, const char *suffix) {
+    static const char special[] = " \t\n\\'\"|;&<>()$`*?[]{}!#";
+    size_t n = strlen(s), k = 0;
+    char *r = malloc(n * 2 + strlen(suffix) + 1);
+    if (!r) return NULL;
+    for (size_t i = 0; i < n; ++i) {
+        if (strchr(special, s[i])) r[k++] = '\\';
+        r[k++] = s[i];
+    }
+    strcpy(r + k, suffix);
+    return r;
+}
+
+static int add_item(Completion *c, size_t *cap, const char *word, const char *suffix) {
+    if (c->n == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 32;
+        char **p = realloc(c->items, sizeof(char *) * ncap);
+        if (!p) return 1;
+        c->items = p;
+        *cap = ncap;
+    }
+    char *item = escape_word(word, suffix);
+    if (!item) return 1;
+    c->items[c->n++] = item;
+    return 0;
+}
+
+static void complete_command(const char *prefix, Completion *c) {
+    size_t cap = 0, plen = strlen(prefix);
+    path_index_update();
+
+    // первое имя, не меньшее префикса; дальше подряд идут все с этим префиксом
+    size_t lo = 0, hi = ncommands;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (strcmp(commands[mid], prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    for (size_t i = lo; i < ncommands && strncmp(commands[i], prefix, plen) == 0; ++i) {
+        if (add_item(c, &cap, commands[i], "") != 0) return;
+    }
+
+    // встроенные команды, которых нет среди файлов
+    size_t nb;
+    const Builtin *b = builtin_list(&nb);
+    for (size_t i = 0; i < nb; ++i) {
+        if (strncmp(b[i].name, prefix, plen) != 0 || !find_builtin(b[i].name)) continue;
+        if (bsearch(&b[i].name, commands, ncommands, sizeof(char *), cmp_str)) continue;
+        if (add_item(c, &cap, b[i].name, "") != 0) return;
+    }
+    qsort(c->items, c->n, sizeof(char *), cmp_str);
+}
+
+static void complete_file(const char *word, Completion *c) {
+    size_t cap = 0;
+    const char *slash = strrchr(word, '/');
+    const char *prefix = slash ? slash + 1 : word;
+    size_t dlen = slash ? (size_t)(slash - word) + 1 : 0;
+
+    char *dir;
+    const char *home = getenv("HOME");
+    if (dlen == 0) dir = strdup(".");
+    else if (word[0] == '~' && word[1] == '/' && home) {
+        if (asprintf(&dir, "%s%.*s", home, (int)dlen - 1, word + 1) < 0) dir = NULL;
+    } else dir = strndup(word, dlen);
+    if (!dir) return;
+
+    NameList *l = cached_dir(dir);
+    free(dir);
+    if (!l) return;
+
+    size_t plen = strlen(prefix);
+    for (size_t i = 0; i < l->n; ++i) {
+        const char *name = l->names[i];
+        if (strncmp(name, prefix, plen) != 0) continue;
+        if (name[0] == '.' && prefix[0] != '.') continue; // скрытые - только если их просят
+
+        char *full;
+        if (asprintf(&full, "%.*s%s", (int)dlen, word, name) < 0) return;
+        int rc = add_item(c, &cap, full, l->is_dir[i] ? "/" : "");
+        free(full);
+        if (rc != 0) return;
+    }
+    qsort(c->items, c->n, sizeof(char *), cmp_str);
+}
+
+// Слово под курсором: от последнего неэкранированного разделителя до pos.
+// Команда - в начале строки или после | ; & ( и без '/'.
+int complete(const char *line, size_t pos, Completion *c) {
+    memset(c, 0, sizeof(*c));
+    if (!line) line = "";
+
+    size_t start = pos;
+    while (start > 0 && !(strchr(" \t|;&<>()", line[start - 1]) && !(start >= 2 && line[start - 2] == '\\'))) start--;
+    c->start = start;
+
+    char *word = malloc(pos - start + 1);
+    if (!word) return 1;
+    size_t k = 0;
+    for (size_t i = start; i < pos; ++i) {
+        if (line[i] == '\\' && i + 1 < pos) i++;
+        word[k++] = line[i];
+    }
+    word[k] = '\0';
+
+    size_t p = start;
+    while (p > 0 && (line[p - 1] == ' ' || line[p - 1] == '\t')) p--;
+    int command = (p == 0 || strchr("|;&(", line[p - 1])) && !strchr(word, '/');
+
+    if (command) complete_command(word, c);
+    else complete_file(word, c);
+    free(word);
+
+    // единственный вариант - слово закончено
+    if (c->n == 1) {
+        size_t len = strlen(c->items[0]);
+        if (len == 0 || c->items[0][len - 1] != '/') {
+            char *p2 = realloc(c->items[0], len + 2);
+            if (p2) {
+                strcpy(p2 + len, " ");
+                c->items[0] = p2;
+            }
+        }
+    }
+    return 0;
+}
+
+void completion_free(Completion *c) {
+    for (size_t i = 0; i < c->n; ++i) free(c->items[i]);
+    free(c->items);
+    memset(c, 0, sizeof(*c));
+}
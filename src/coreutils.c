@@ -0,0 +1,633 @@
+#define _GNU_SOURCE
+
+#include "../inc/builtin.h"
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// Утилиты, которые дешевле выполнить внутри шелла, чем делать fork + exec.
+// Если утилите передали то, что она не умеет, она возвращает BUILTIN_DEFER
+// и шелл запускает внешнюю программу.
+
+#define CAT_CHUNK (1 << 20)
+
+extern int shell_is_interactive;
+
+int builtin_true(char **argv) {
+    (void)argv;
+    return 0;
+}
+
+int builtin_false(char **argv) {
+    (void)argv;
+    return 1;
+}
+
+
+// ---------- cat ----------
+
+// обычное копирование через буфер, если ядро не умеет быстрее
+static int cat_copy_rw(int in, int out) {
+    char buf[65536];
+    while (1) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return 0;
+
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            off += w;
+        }
+    }
+}
+
+// копирование внутри ядра: copy_file_range для файла, splice для пайпа, sendfile для остального
+static int cat_copy_fd(int in, int out) {
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) < 0 || fstat(out, &out_st) < 0) return cat_copy_rw(in, out);
+
+    int in_is_file = S_ISREG(in_st.st_mode);
+    int in_is_pipe = S_ISFIFO(in_st.st_mode);
+
+    if (in_is_file && S_ISREG(out_st.st_mode) && !(fcntl(out, F_GETFL) & O_APPEND)) {
+        ssize_t n;
+        while ((n = copy_file_range(in, NULL, out, NULL, CAT_CHUNK, 0)) > 0);
+        if (n == 0) return 0;
+        // EXDEV, EINVAL, ENOSYS - пробуем дальше обычными способами
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) return -1;
+    }
+
+    if (S_ISFIFO(out_st.st_mode) || in_is_pipe) {
+        ssize_t n;
+        while ((n = splice(in, NULL, out, NULL, CAT_CHUNK, SPLICE_F_MOVE)) > 0);
+        if (n == 0) return 0;
+        if (errno != EINVAL) return -1;
+    }
+
+    if (in_is_file) {
+        ssize_t n;
+        while ((n = sendfile(out, in, NULL, CAT_CHUNK)) > 0);
+        if (n == 0) return 0;
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+    }
+
+    return cat_copy_rw(in, out);
+}
+
+// вход, чтение которого может не кончиться (терминал, /dev/zero, fifo)
+static int cat_endless(const char *path) {
+    struct stat st;
+    int r = path ? stat(path, &st) : fstat(STDIN_FILENO, &st);
+    return r == 0 && (S_ISCHR(st.st_mode) || S_ISFIFO(st.st_mode));
+}
+
+int builtin_cat(char **argv) {
+    // опции (-n, -A ...) оставляем настоящему cat
+    int have_files = 0, reads_stdin = 0;
+    for (int i = 1; argv[i]; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            if (strcmp(argv[i], "-u") == 0) continue;
+            return BUILTIN_DEFER;
+        }
+        have_files = 1;
+        if (strcmp(argv[i], "-") == 0) reads_stdin = 1;
+    }
+
+    // интерактивный шелл игнорирует SIGINT: cat внутри него не прервать по Ctrl-C.
+    // Бесконечный вход отдаем внешнему cat в своей группе с обычными сигналами
+    if (shell_is_interactive) {
+        if ((!have_files || reads_stdin) && cat_endless(NULL)) return BUILTIN_DEFER;
+        for (int i = 1; argv[i]; ++i) {
+            if (strcmp(argv[i], "-u") != 0 && strcmp(argv[i], "-") != 0 && cat_endless(argv[i])) {
+                return BUILTIN_DEFER;
+            }
+        }
+    }
+
+    // cat пишет в дескриптор напрямую, всё накопленное должно уйти раньше
+    out_flush_all();
+
+    int rc = 0;
+    for (int i = 1; argv[i]; ++i) {
+        if (strcmp(argv[i], "-u") == 0) continue;
+
+        int fd = STDIN_FILENO;
+        if (strcmp(argv[i], "-") != 0) {
+            fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                out_errorf("cat: %s: %s\n", argv[i], strerror(errno));
+                rc = 1;
+                continue;
+            }
+        }
+
+        if (cat_copy_fd(fd, STDOUT_FILENO) < 0) {
+            out_errorf("cat: %s: %s\n", argv[i], strerror(errno));
+            rc = 1;
+        }
+        if (fd != STDIN_FILENO) close(fd);
+    }
+
+    if (!have_files && cat_copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0) {
+        out_errorf("cat: %s\n", strerror(errno));
+        rc = 1;
+    }
+    return rc;
+}
+
+
+// ---------- test / [ ----------
+
+// кэш результатов stat: в цепочке [ -f x ] && [ -r x ] && [ -s x ] файл проверяется один раз.
+// сбрасывается перед любой другой командой, чтобы не видеть устаревших данных
+#define TEST_CACHE_SIZE 16
+
+typedef struct {
+    char *path;
+    int follow;       // stat или lstat
+    int err;          // errno, если вызов не удался
+    struct stat st;
+} StatCacheEntry;
+
+static StatCacheEntry stat_cache[TEST_CACHE_SIZE];
+static int stat_cache_len = 0;
+
+void test_cache_reset(void) {
+    for (int i = 0; i < stat_cache_len; ++i) {
+        free(stat_cache[i].path);
+    }
+    stat_cache_len = 0;
+}
+
+static int cached_stat(const char *path, int follow, struct stat *st) {
+    for (int i = 0; i < stat_cache_len; ++i) {
+        if (stat_cache[i].follow == follow && strcmp(stat_cache[i].path, path) == 0) {
+            if (stat_cache[i].err) return -1;
+            *st = stat_cache[i].st;
+            return 0;
+        }
+    }
+
+    int rc = follow ? stat(path, st) : lstat(path, st);
+
+    // кэш переполнен - вытесняем первую запись
+    if (stat_cache_len == TEST_CACHE_SIZE) {
+        free(stat_cache[0].path);
+        memmove(stat_cache, stat_cache + 1, sizeof(StatCacheEntry) * (TEST_CACHE_SIZE - 1));
+        stat_cache_len--;
+    }
+
+    StatCacheEntry *e = &stat_cache[stat_cache_len];
+    e->path = strdup(path);
+    if (!e->path) return rc;
+    e->follow = follow;
+    e->err = rc < 0 ? errno : 0;
+    if (rc == 0) e->st = *st;
+    stat_cache_len++;
+
+    return rc;
+}
+
+typedef struct {
+    char **argv;
+    int pos;
+    int end;
+    int error;
+} TestParser;
+
+static int parse_int(const char *s, long long *out) {
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (end == s || errno != 0) return -1;
+    while (*end == ' ' || *end == '\t') end++;
+    if (*end != '\0') return -1;
+    *out = v;
+    return 0;
+}
+
+static int is_unary_op(const char *s) {
+    return s[0] == '-' && s[1] != '\0' && s[2] == '\0' && strchr("bcdefghLnprsStuwxzGO", s[1]);
+}
+
+static int is_binary_op(const char *s) {
+    static const char *ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL
+    };
+    for (int i = 0; ops[i]; ++i) {
+        if (strcmp(s, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int test_unary(TestParser *p, char op, const char *arg) {
+    struct stat st;
+
+    switch (op) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 't': {
+            long long fd;
+            if (parse_int(arg, &fd) != 0) {
+                out_errorf("test: %s: integer expression expected\n", arg);
+                p->error = 1;
+                return 0;
+            }
+            return isatty((int)fd);
+        }
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 'h':
+        case 'L': return cached_stat(arg, 0, &st) == 0 && S_ISLNK(st.st_mode);
+        default: break;
+    }
+
+    if (cached_stat(arg, 1, &st) != 0) return 0;
+
+    switch (op) {
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'G': return st.st_gid == getegid();
+        case 'O': return st.st_uid == geteuid();
+        default:  return 0;
+    }
+}
+
+static int test_binary(TestParser *p, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        int ha = cached_stat(a, 1, &sa) == 0;
+        int hb = cached_stat(b, 1, &sb) == 0;
+
+        if (op[1] == 'e') return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+
+        // у несуществующего файла время считается самым старым
+        if (!ha || !hb) return op[1] == 'n' ? (ha && !hb) : (!ha && hb);
+
+        long long ta = (long long)sa.st_mtim.tv_sec * 1000000000LL + sa.st_mtim.tv_nsec;
+        long long tb = (long long)sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+        return op[1] == 'n' ? ta > tb : ta < tb;
+    }
+
+    long long x, y;
+    if (parse_int(a, &x) != 0 || parse_int(b, &y) != 0) {
+        out_errorf("test: integer expression expected\n");
+        p->error = 1;
+        return 0;
+    }
+
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y; // -ge
+}
+
+static int test_or(TestParser *p);
+
+// primary := '(' expr ')' | unary arg | arg binop arg | arg
+static int test_primary(TestParser *p) {
+    if (p->pos >= p->end) {
+        out_errorf("test: argument expected\n");
+        p->error = 1;
+        return 0;
+    }
+
+    char **a = p->argv + p->pos;
+    int left = p->end - p->pos;
+
+    // сначала бинарная форма: [ "-f" = "-f" ] сравнивает строки
+    if (left >= 3 && is_binary_op(a[1])) {
+        p->pos += 3;
+        return test_binary(p, a[0], a[1], a[2]);
+    }
+
+    if (strcmp(a[0], "(") == 0) {
+        p->pos++;
+        int r = test_or(p);
+        if (p->pos >= p->end || strcmp(p->argv[p->pos], ")") != 0) {
+            out_errorf("test: missing ')'\n");
+            p->error = 1;
+            return 0;
+        }
+        p->pos++;
+        return r;
+    }
+
+    if (left >= 2 && is_unary_op(a[0])) {
+        p->pos += 2;
+        return test_unary(p, a[0][1], a[1]);
+    }
+
+    p->pos++;
+    return a[0][0] != '\0';
+}
+
+static int test_not(TestParser *p) {
+    if (p->pos < p->end && strcmp(p->argv[p->pos], "!") == 0 && p->end - p->pos > 1) {
+        p->pos++;
+        return !test_not(p);
+    }
+    return test_primary(p);
+}
+
+static int test_and(TestParser *p) {
+    int r = test_not(p);
+    while (!p->error && p->pos < p->end && strcmp(p->argv[p->pos], "-a") == 0) {
+        p->pos++;
+        int rhs = test_not(p);
+        r = r && rhs;
+    }
+    return r;
+}
+
+static int test_or(TestParser *p) {
+    int r = test_and(p);
+    while (!p->error && p->pos < p->end && strcmp(p->argv[p->pos], "-o") == 0) {
+        p->pos++;
+        int rhs = test_and(p);
+        r = r || rhs;
+    }
+    return r;
+}
+
+int builtin_test(char **argv) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+
+    // [ требует закрывающую ]
+    if (strcmp(argv[0], "[") == 0) {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+            out_errorf("[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    TestParser p = { argv, 1, argc, 0 };
+    if (p.end == 1) return 1; // без аргументов - ложь
+
+    int r = test_or(&p);
+    if (!p.error && p.pos != p.end) {
+        out_errorf("%s: too many arguments\n", argv[0]);
+        return 2;
+    }
+    if (p.error) return 2;
+    return r ? 0 : 1;
+}
+
+
+// ---------- printf ----------
+
+// разбор escape-последовательности, возвращает число прочитанных символов после '\'
+static int print_escape(const char *s, int in_arg, int *stop) {
+    switch (*s) {
+        case 'n':  out_putc(STDOUT_FILENO, '\n'); return 1;
+        case 't':  out_putc(STDOUT_FILENO, '\t'); return 1;
+        case 'r':  out_putc(STDOUT_FILENO, '\r'); return 1;
+        case 'a':  out_putc(STDOUT_FILENO, '\a'); return 1;
+        case 'b':  out_putc(STDOUT_FILENO, '\b'); return 1;
+        case 'f':  out_putc(STDOUT_FILENO, '\f'); return 1;
+        case 'v':  out_putc(STDOUT_FILENO, '\v'); return 1;
+        case 'e':  out_putc(STDOUT_FILENO, '\033'); return 1;
+        case '\\': out_putc(STDOUT_FILENO, '\\'); return 1;
+        case 'c':
+            if (in_arg) {
+                *stop = 1;
+                return 1;
+            }
+            break;
+        case '0': case '1': case '2': case '3':
+        case '4': case '5': case '6': case '7': {
+            // в %b формат \0NNN, в строке формата \NNN
+            int i = (in_arg && *s == '0') ? 1 : 0;
+            int v = 0, digits = 0;
+            while (digits < 3 && s[i] >= '0' && s[i] <= '7') {
+                v = v * 8 + (s[i] - '0');
+                i++;
+                digits++;
+            }
+            out_putc(STDOUT_FILENO, v);
+            return i;
+        }
+        default:
+            break;
+    }
+    out_putc(STDOUT_FILENO, '\\');
+    if (*s == '\0') return 0;
+    out_putc(STDOUT_FILENO, *s);
+    return 1;
+}
+
+// числовой аргумент: 'c и "c дают код символа
+static long long printf_number(const char *arg, int *rc) {
+    if (!arg) return 0;
+    if (arg[0] == '\'' || arg[0] == '"') return (unsigned char)arg[1];
+
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(arg, &end, 0);
+    if (end == arg || *end != '\0' || errno != 0) {
+        out_errorf("printf: %s: invalid number\n", arg);
+        *rc = 1;
+    }
+    return v;
+}
+
+int builtin_printf(char **argv) {
+    if (!argv[1]) {
+        out_errorf("printf: usage: printf format [arguments]\n");
+        return 1;
+    }
+
+    const char *fmt = argv[1];
+    char **args = argv + 2;
+    int rc = 0;
+    int stop = 0;
+
+    // формат переиспользуется, пока не кончатся аргументы
+    do {
+        int consumed = 0;
+
+        for (const char *f = fmt; *f && !stop; ++f) {
+            if (*f == '\\') {
+                f += print_escape(f + 1, 0, &stop);
+                continue;
+            }
+            if (*f != '%') {
+                out_putc(STDOUT_FILENO, *f);
+                continue;
+            }
+            if (f[1] == '%') {
+                out_putc(STDOUT_FILENO, '%');
+                f++;
+                continue;
+            }
+
+            // собираем спецификацию: флаги, ширина, точность
+            char spec[64];
+            size_t sl = 0;
+            spec[sl++] = '%';
+            f++;
+            while (*f && strchr("-+ #0", *f) && sl < 40) spec[sl++] = *f++;
+            while (*f && ((*f >= '0' && *f <= '9') || *f == '.' || *f == '*') && sl < 40) {
+                if (*f == '*') {
+                    // ширина из аргумента
+                    int w = (int)printf_number(*args, &rc);
+                    if (*args) {
+                        args++;
+                        consumed = 1;
+                    }
+                    sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", w);
+                    f++;
+                    continue;
+                }
+                spec[sl++] = *f++;
+            }
+
+            const char *arg = *args;
+            if (arg) {
+                args++;
+                consumed = 1;
+            }
+
+            switch (*f) {
+                case 'd': case 'i': {
+                    spec[sl++] = 'l'; spec[sl++] = 'l'; spec[sl++] = *f; spec[sl] = '\0';
+                    out_printf(STDOUT_FILENO, spec, printf_number(arg, &rc));
+                    break;
+                }
+                case 'u': case 'x': case 'X': case 'o': {
+                    spec[sl++] = 'l'; spec[sl++] = 'l'; spec[sl++] = *f; spec[sl] = '\0';
+                    out_printf(STDOUT_FILENO, spec, (unsigned long long)printf_number(arg, &rc));
+                    break;
+                }
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': {
+                    spec[sl++] = *f; spec[sl] = '\0';
+                    double d = 0;
+                    if (arg) {
+                        char *end = NULL;
+                        d = strtod(arg, &end);
+                        if (end == arg || *end != '\0') {
+                            out_errorf("printf: %s: invalid number\n", arg);
+                            rc = 1;
+                        }
+                    }
+                    out_printf(STDOUT_FILENO, spec, d);
+                    break;
+                }
+                case 'c':
+                    // без аргумента символа нет: не печатаем '\0', только ширину, как %s с ""
+                    if (!arg || !arg[0]) {
+                        spec[sl++] = 's'; spec[sl] = '\0';
+                        out_printf(STDOUT_FILENO, spec, "");
+                        break;
+                    }
+                    spec[sl++] = 'c'; spec[sl] = '\0';
+                    out_printf(STDOUT_FILENO, spec, arg[0]);
+                    break;
+                case 's':
+                    spec[sl++] = 's'; spec[sl] = '\0';
+                    out_printf(STDOUT_FILENO, spec, arg ? arg : "");
+                    break;
+                case 'b':
+                    for (const char *b = arg ? arg : ""; *b && !stop; ++b) {
+                        if (*b == '\\') {
+                            b += print_escape(b + 1, 1, &stop);
+                        } else {
+                            out_putc(STDOUT_FILENO, *b);
+                        }
+                    }
+                    break;
+                default:
+                    out_errorf("printf: %%%c: invalid directive\n", *f ? *f : ' ');
+                    return 1;
+            }
+            if (*f == '\0') break;
+        }
+
+        if (!consumed) break;
+    } while (*args && !stop);
+
+    return rc;
+}
+
+
+// ---------- basename / dirname ----------
+
+int builtin_basename(char **argv) {
+    if (!argv[1] || (argv[1][0] == '-' && argv[1][1] != '\0') || (argv[2] && argv[3])) {
+        return BUILTIN_DEFER; // -a, -s, лишние аргументы - пусть разбирается внешний basename
+    }
+
+    const char *path = argv[1];
+    size_t len = strlen(path);
+
+    // отбрасываем завершающие '/'
+    while (len > 1 && path[len - 1] == '/') len--;
+
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') start--;
+    if (len == 1 && path[0] == '/') start = 0;
+
+    size_t name_len = len - start;
+
+    // суффикс убираем, только если он не совпадает с именем целиком
+    if (argv[2]) {
+        size_t sl = strlen(argv[2]);
+        if (sl < name_len && strncmp(path + len - sl, argv[2], sl) == 0) name_len -= sl;
+    }
+
+    out_printf(STDOUT_FILENO, "%.*s\n", (int)name_len, path + start);
+    return 0;
+}
+
+int builtin_dirname(char **argv) {
+    if (!argv[1] || (argv[1][0] == '-' && argv[1][1] != '\0') || argv[2]) {
+        return BUILTIN_DEFER;
+    }
+
+    const char *path = argv[1];
+    size_t len = strlen(path);
+
+    while (len > 1 && path[len - 1] == '/') len--;       // завершающие '/'
+    while (len > 0 && path[len - 1] != '/') len--;       // последний компонент
+    while (len > 1 && path[len - 1] == '/') len--;       // разделитель
+
+    if (len == 0) {
+        out_puts(STDOUT_FILENO, ".\n");
+    } else {
+        out_printf(STDOUT_FILENO, "%.*s\n", (int)len, path);
+    }
+    return 0;
+}
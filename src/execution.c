@@ -1,6 +1,16 @@
+#define _GNU_SOURCE
+
 #include "../inc/execution.h"
 #include "../inc/jobs.h"
 #include "../inc/builtin.h"
+#include "../inc/outbuf.h"
+#include "../inc/expand.h"
+#include "../inc/procsubst.h"
+#include "../inc/arith.h"
+#include "../inc/multios.h"
+#include "../inc/options.h"
+#include "../inc/zygote.h"
+#include "../inc/shell.h"
 #include <signal.h>
 #include <termios.h>
 #include <stdio.h>
@@ -10,109 +20,166 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
 
-extern Job *first_job;             // голова списка фоновых заданий
 extern int shell_terminal;         // файловый дескриптор терминала (обычно STDIN)
 extern int shell_is_interactive;   // флаг: работаем ли в интерактивном режиме
 extern pid_t shell_pgid;           // идентификатор группы процессов shell
 
-// код завершения последней выполненной команды (для переменной $?)
-int g_last_status = 0;
 
-// пид последнего фонового задания (для переменной $!)
-pid_t g_last_bg_pgid = 0;
+// ставим открытый дескриптор на нужный номер
+static int move_fd(int fd, int target) {
+    if (fd == target) {
+        // открыли сразу в нужный номер - снимаем O_CLOEXEC, чтобы exec его унаследовал
+        return fcntl(fd, F_SETFD, 0);
+    }
+    if (dup2(fd, target) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Тело here-document уходит в память, а не во временный файл:
+// маленькое - в пайп (запись не блокируется), большое - в memfd
+static int make_heredoc_fd(const char *body) {
+    size_t len = strlen(body);
+
+    if (len <= PIPE_BUF) {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) == 0) {
+            int rc = write_all(p[1], body, len);
+            close(p[1]);
+            if (rc == 0) return p[0];
+            close(p[0]);
+        }
+    }
+
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (write_all(fd, body, len) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+        perror("heredoc");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// готовим дескрипторы всех here-document команды заранее, до fork
+int prepare_heredocs(Redirection *redir) {
+    for (Redirection *r = redir; r; r = r->next) {
+        if (r->type != REDIR_HEREDOC || r->src_fd >= 0) continue;
+
+        // <<EOF и <<<word раскрываются, <<'EOF' - нет
+        if (r->expand) {
+            char *body = expand_word(r->filename, r->expand == HEREDOC_EXPAND_BODY ? EXPAND_HEREDOC : EXPAND_WORD);
+            r->src_fd = body ? make_heredoc_fd(body) : -1;
+            free(body);
+        } else {
+            r->src_fd = make_heredoc_fd(r->filename);
+        }
+        if (r->src_fd < 0) {
+            release_heredocs(redir);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// после fork родителю дескрипторы тел больше не нужны
+void release_heredocs(Redirection *redir) {
+    for (Redirection *r = redir; r; r = r->next) {
+        if (r->type == REDIR_HEREDOC && r->src_fd >= 0) {
+            close(r->src_fd);
+            r->src_fd = -1;
+        }
+    }
+}
 
 int handle_redirection(Redirection *redir) {
     // Проходим по связному списку всех перенаправлений для этой команды
     for (Redirection *r = redir; r; r = r->next) {
-        int fd = -1;  
-
         switch (r->type) {
-            case REDIR_IN:  // < 
-                fd = open(r->filename, O_RDONLY);
-                if (fd < 0) { 
-                    perror(r->filename); 
-                    return 1; 
-                }  
-                // копируем дескриптор fd в STDIN (0)
-                if (dup2(fd, STDIN_FILENO) < 0) { 
-                    perror("dup2"); 
-                    close(fd); 
-                    return 1; 
+            case REDIR_DUP:  // n>&m 
+                if (r->src_fd == r->fd) {
+                    // n>&n - только проверяем, что дескриптор открыт
+                    if (fcntl(r->fd, F_GETFD) < 0) {
+                        fprintf(stderr, "%d: bad file descriptor\n", r->src_fd);
+                        return 1;
+                    }
+                    break;
                 }
-
-                close(fd);  // Закрываем оригинальный дескриптор (он больше не нужен)
-                break;
-
-            case REDIR_OUT:  // Перенаправление вывода: > file
-                fd = open(r->filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-                if (fd < 0) { 
-                    perror(r->filename); 
-                    return 1; 
-                } 
-
-                if (dup2(fd, STDOUT_FILENO) < 0) { 
-                    perror("dup2"); close(fd); 
-                    return 1; 
+                if (dup2(r->src_fd, r->fd) < 0) {
+                    fprintf(stderr, "%d: bad file descriptor\n", r->src_fd);
+                    return 1;
                 }
+                break;
 
-                close(fd);  // Закрываем оригинальный дескриптор
+            case REDIR_CLOSE:  // n>&-
+                close(r->fd);
                 break;
 
-            case REDIR_APPEND:  // >> 
-                fd = open(r->filename, O_CREAT | O_WRONLY | O_APPEND, 0644);
-                if (fd < 0) { 
-                    perror(r->filename); 
-                    return 1; 
-                }  
-                
-                if (dup2(fd, STDOUT_FILENO) < 0) {
-                    perror("dup2"); 
-                    close(fd); 
+            case REDIR_HEREDOC:  // <<EOF - тело уже в пайпе или memfd
+                if (r->src_fd < 0 && prepare_heredocs(r) != 0) return 1;
+                if (dup2(r->src_fd, r->fd) < 0) {
+                    perror("dup2");
                     return 1;
                 }
-                close(fd); 
                 break;
 
-            case REDIR_ERR_OUT:  //  &> 
-                fd = open(r->filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-                if (fd < 0) { 
-                    perror(r->filename); 
-                    return 1; 
-                }  
-               
-                if (dup2(fd, STDOUT_FILENO) < 0) { 
-                    perror("dup2"); \
-                    close(fd); 
-                    return 1; 
-                }
-    
-                if (dup2(fd, STDERR_FILENO) < 0) { 
-                    perror("dup2"); 
-                    close(fd); 
-                    return 1; 
+            case REDIR_OUT:         // >
+            case REDIR_APPEND:      // >>
+                if (r->multios == MULTIOS_MEMBER) break; // файл открыл помощник группы
+                if (r->multios == MULTIOS_LEADER) {
+                    if (r->src_fd < 0 && multios_prepare(r) != 0) return 1;
+                    if (dup2(r->src_fd, r->fd) < 0) {
+                        perror("dup2");
+                        return 1;
+                    }
+                    break;
                 }
-                close(fd);  
-                break;
-
-            case REDIR_ERR_APPEND:  //  &>>
-                fd = open(r->filename, O_CREAT | O_WRONLY | O_APPEND, 0644);
+                // fall through
+            case REDIR_IN:          // <
+            case REDIR_RDWR:        // <>
+            case REDIR_ERR_OUT:     // &>
+            case REDIR_ERR_APPEND: { // &>>
+                // флаги посчитаны при разборе, O_CLOEXEC - чтобы ничего не утекло при ошибке
+                int fd = open(r->filename, r->open_flags | O_CLOEXEC, 0644);
                 if (fd < 0) { 
                     perror(r->filename); 
                     return 1; 
                 }
-                if (dup2(fd, STDOUT_FILENO) < 0) { 
+
+                if (move_fd(fd, r->fd) < 0) {
                     perror("dup2"); 
-                    close(fd); 
                     return 1; 
                 }
-                if (dup2(fd, STDERR_FILENO) < 0) { 
+
+                // &> и &>> пишут и stdout, и stderr в один файл
+                if ((r->type == REDIR_ERR_OUT || r->type == REDIR_ERR_APPEND) && dup2(r->fd, STDERR_FILENO) < 0) {
                     perror("dup2"); 
-                    close(fd); 
                     return 1; 
                 }
-                close(fd);  
                 break;
+            }
 
             default:
                 fprintf(stderr, "redir: unknown type\n");  
@@ -122,36 +189,103 @@ int handle_redirection(Redirection *redir) {
     return 0;  
 }
 
-void expand_argv(char **argv) {
-    for (int i = 0; argv && argv[i]; i++) {
-        if (argv[i][0] != '$') continue;
+// сохраняем дескрипторы из плана выше 10, чтобы не пересечься с пользовательскими n>file
+int save_redir_fds(RedirPlan *plan, int *saved) {
+    for (int i = 0; i < plan->n_touched; ++i) {
+        saved[i] = fcntl(plan->touched[i], F_DUPFD_CLOEXEC, 10);
+        if (saved[i] < 0 && errno != EBADF) {
+            perror("fcntl");
+            while (--i >= 0) {
+                if (saved[i] >= 0) close(saved[i]);
+            }
+            return 1;
+        }
+        // EBADF - дескриптор был закрыт, при восстановлении просто закроем его
+    }
+    return 0;
+}
 
-        char buf[32];        
-        const char *rep = ""; 
+void restore_redir_fds(RedirPlan *plan, int *saved) {
+    for (int i = 0; i < plan->n_touched; ++i) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], plan->touched[i]);
+            close(saved[i]);
+        } else {
+            close(plan->touched[i]);
+        }
+    }
+}
+
+// раскрываем аргументы и имена файлов команды; слова без $ и ` не трогаем
+int expand_command(ASTNode *node) {
+    char **argv = node->command.argv;
+    int argc = node->command.argc;
+
+    int need = 0;
+    for (int i = 0; i < argc && !need; i++) {
+        if (needs_expansion(argv[i])) need = 1;
+    }
 
-        if (strcmp(argv[i], "$?") == 0) { // код возврата последней команды
-            snprintf(buf, sizeof(buf), "%d", g_last_status);
-            rep = buf; 
-        } else if (strcmp(argv[i], "$$") == 0) { // проверка пид текущего процесса
-            snprintf(buf, sizeof(buf), "%d", (int)getpid());
-            rep = buf;  
-        } else if (strcmp(argv[i], "$!") == 0) { // пид последного фонового процесса
-            snprintf(buf, sizeof(buf), "%d", (int)g_last_bg_pgid);
-            rep = buf;  
-        } else { // переменная окружения
-            const char *env = getenv(argv[i] + 1);
-            rep = env ? env : "";
+    int failed = 0;
+    if (need) {
+        int cap = argc + 1, n = 0;
+        char **new_argv = malloc(sizeof(char *) * cap);
+        if (!new_argv) {
+            perror("malloc");
+            return 1;
         }
 
-        // копия строки замены в динамической памяти
-        char *dup = strdup(rep);
-        if (!dup) { 
-            perror("strdup");  
-            continue; 
+        for (int i = 0; i < argc; i++) {
+            if (!needs_expansion(argv[i])) {
+                new_argv[n++] = argv[i];
+                continue;
+            }
+
+            // одно слово может дать несколько полей или ни одного
+            char **fields = NULL;
+            int nf = 0;
+            if (expand_fields(argv[i], &fields, &nf) != 0) {
+                failed = 1;
+                nf = 0;
+            }
+            free(argv[i]);
+
+            if (n + nf + 1 > cap) {
+                cap = n + nf + 1 + (argc - i);
+                char **tmp = realloc(new_argv, sizeof(char *) * cap);
+                if (!tmp) {
+                    for (int k = 0; k < nf; k++) free(fields[k]);
+                    free(fields);
+                    continue;
+                }
+                new_argv = tmp;
+            }
+            for (int k = 0; k < nf; k++) new_argv[n++] = fields[k];
+            free(fields);
         }
-        free(argv[i]);
-        argv[i] = dup;
+        new_argv[n] = NULL;
+
+        free(argv);
+        node->command.argv = new_argv;
+        node->command.argc = n;
     }
+    if (failed) return 1;
+
+    return expand_redirs(node->command.redir);
+}
+
+// имена файлов раскрываются без деления на поля
+int expand_redirs(Redirection *redir) {
+    for (Redirection *r = redir; r; r = r->next) {
+        if (r->type == REDIR_HEREDOC || r->type == REDIR_DUP || r->type == REDIR_CLOSE) continue;
+        if (!needs_expansion(r->filename)) continue;
+
+        char *name = expand_word(r->filename, EXPAND_WORD);
+        if (!name) return 1;
+        free(r->filename);
+        r->filename = name;
+    }
+    return 0;
 }
 
 
@@ -162,15 +296,21 @@ int exec_command_in_child(ASTNode *node) {
 
     if (!argv || !argv[0]) _exit(0); 
     
-    expand_argv(argv);
+    if (expand_command(node) != 0) _exit(1);
+    argv = node->command.argv;
+    if (!argv[0]) _exit(0);
+
+    out_flush_all(); // в mybash -c до exec без fork мог накопиться вывод встроенных
 
     // выполняем все перенаправления
     if (handle_redirection(node->command.redir) != 0) 
         _exit(1); 
+    procsubst_exec_prepare(); // /dev/fd/N от <(...) должны пережить exec
     // встроенные команды
     if (is_builtin(argv[0])) {
         int rc = run_builtin(argv);
-        _exit(rc);  
+        out_flush_all(); // _exit не сбрасывает буферы
+        if (rc != BUILTIN_DEFER) _exit(rc);
     }
 
     execvp(argv[0], argv);
@@ -272,9 +412,54 @@ int flatten_pipeline(ASTNode *node, ASTNode ***stages_out, int **pipe_stderr_out
 }
 
 
+static int status_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return 1;
+}
+
+// PIPESTATUS - коды стадий последнего конвейера. Это состояние шелла, а не
+// переменная окружения: внешним программам оно не передается (expand.c)
+static void set_pipestatus(const int *codes, int n) {
+    if (n > g_sh->pipestatus_cap) {
+        int *p = realloc(g_sh->pipestatus, sizeof(int) * n);
+        if (!p) return;
+        g_sh->pipestatus = p;
+        g_sh->pipestatus_cap = n;
+    }
+    memcpy(g_sh->pipestatus, codes, sizeof(int) * n);
+    g_sh->pipestatus_n = n;
+}
+
+// set -o pipefail: код последней упавшей стадии, 0 - если упавших нет
+static int pipefail_code(const int *codes, int n) {
+    for (int i = n - 1; i >= 0; --i) {
+        if (codes[i] != 0) return codes[i];
+    }
+    return 0;
+}
+
 int wait_foreground_pgid(pid_t pgid, pid_t last_pid) {
     int last_status = 0;  // завершения последнего процесса 
 
+    // процессы задания известны - ждем их pidfd, стадии сами запишут статусы
+    Job *job = find_job_by_pgid(pgid);
+    if (job && job->first_process) {
+        if (jobs_wait(&job, 1, JOB_WAIT_STOP, -1) == JOB_WAIT_STOPPED) {
+            return job_exit_code(job);
+        }
+
+        // помощники <(...) той же группы: собираем, когда они закончат
+        int status;
+        while (waitpid(-pgid, &status, WUNTRACED) > 0 || errno == EINTR);
+
+        for (Process *p = job->first_process; p; p = p->next) {
+            if (p->pid == last_pid) return status_code(p->status);
+        }
+        return job_exit_code(job);
+    }
+
     // ожидание процессов в группе
     while (1) {
         int status = 0;  // завершения процесса
@@ -290,6 +475,9 @@ int wait_foreground_pgid(pid_t pgid, pid_t last_pid) {
             break;  
         }
 
+        // статус каждой стадии - в её процесс задания (в порядке завершения)
+        mark_process_status(pid, status);
+
         // последний процесс в конвейере, сохраняем его статус
         if (pid == last_pid) {
             last_status = status;  
@@ -314,7 +502,84 @@ int wait_foreground_pgid(pid_t pgid, pid_t last_pid) {
     return 0;  
 }
 
-int execute_pipeline_node(ASTNode *node) {
+// ограничение ядра на размер пайпа для непривилегированных процессов
+static long clamp_pipe_size(long size) {
+    static long max_size = 0;
+
+    if (!max_size) {
+        max_size = 1024 * 1024; // значение по умолчанию в ядре
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "re");
+        if (f) {
+            long v;
+            if (fscanf(f, "%ld", &v) == 1 && v > 0) max_size = v;
+            fclose(f);
+        }
+    }
+    return size > max_size ? max_size : size;
+}
+
+static int cmp_fd(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+static int *sorted_pipe_fds(int (*pipes)[2], int n) {
+    int *fds = malloc(sizeof(int) * 2 * n);
+    if (!fds) return NULL;
+    memcpy(fds, pipes, sizeof(int) * 2 * n);
+    qsort(fds, 2 * n, sizeof(int), cmp_fd);
+    return fds;
+}
+
+// пайпы создаются подряд, так что обычно это один вызов close_range
+static void close_fd_runs(int *fds, int n) {
+    if (!fds) return;
+    int start = 0;
+    for (int i = 1; i <= n; ++i) {
+        if (i == n || fds[i] != fds[i - 1] + 1) {
+            close_range(fds[start], fds[i - 1], 0);
+            start = i;
+        }
+    }
+}
+
+// ограничения из "limit ..." и "affinity ..." самой команды: их сливаем с bgnice
+// до fork и применяем один раз - иначе bgnice уже поднял бы nice, и limit -n
+// с меньшим значением без привилегий не смог бы его вернуть
+static void command_limits(ASTNode *node, JobLimits *lim) {
+    memset(lim, 0, sizeof(*lim));
+    char **argv = node && node->type == NODE_COMMAND ? node->command.argv : NULL;
+    if (!argv || !argv[0]) return;
+
+    if (strcmp(argv[0], "limit") == 0) {
+        if (limits_parse(argv, lim, 0) <= 0) memset(lim, 0, sizeof(*lim));
+    } else if (strcmp(argv[0], "affinity") == 0 && argv[1]) {
+        if (parse_cpu_list(argv[1], lim) != 0) memset(lim, 0, sizeof(*lim));
+    }
+}
+
+// перенаправления стадии: у команды свои, у { } и ( ) - на всю группу
+static Redirection *stage_redir(ASTNode *stage) {
+    if (!stage) return NULL;
+    if (stage->type == NODE_COMMAND) return stage->command.redir;
+    if (stage->type == NODE_GROUP || stage->type == NODE_SUB) return stage->unary.redir;
+    return NULL;
+}
+
+// у стадий конвейера есть группы multios (помощники шелла вне группы задания)
+static int pipeline_has_multios(ASTNode *node) {
+    if (!node) return 0;
+    if (node->type == NODE_PIPE || node->type == NODE_PIPE_STDERR) {
+        return pipeline_has_multios(node->binary.left) || pipeline_has_multios(node->binary.right);
+    }
+    for (Redirection *r = stage_redir(node); r; r = r->next) {
+        if (r->multios == MULTIOS_LEADER) return 1;
+    }
+    return 0;
+}
+
+// background - конвейер с &: стадии сразу становятся фоновым заданием,
+// терминал не отдаем и не ждем
+static int run_pipeline(ASTNode *node, int background) {
     ASTNode **stages = NULL; // массив указателей на команды
     int *pipe_stderr = NULL;
     int count_command = 0;
@@ -332,13 +597,16 @@ int execute_pipeline_node(ASTNode *node) {
     }
 
     // команда без пайпа
-    if (count_command == 1) { 
+    if (count_command == 1 && !background) { 
         int rc = execute_internal(stages[0], 0);
         free(stages);
         free(pipe_stderr);
         return rc;
     }
 
+    test_cache_reset();
+    out_flush_all();
+
     int pipes_count = count_command - 1;
     int (*pipes)[2] = calloc(pipes_count, sizeof(int[2])); //массив пар для пайпа(r/w)
     pid_t *pids = calloc(count_command, sizeof(pid_t)); // массив пидов дочерок
@@ -351,9 +619,13 @@ int execute_pipeline_node(ASTNode *node) {
         return 1;
     }
 
+    // емкость пайпов: pipesize N перед конвейером, иначе set -o pipesize=N
+    long pipe_size = node->binary.pipe_size ? node->binary.pipe_size : get_option_value(OPT_PIPESIZE);
+    if (pipe_size > 0) pipe_size = clamp_pipe_size(pipe_size);
+
     for (int i = 0; i < pipes_count; i++) {
-        // создаем пайпы и чистим если не создались
-        if (pipe(pipes[i]) < 0) {
+        // создаем пайпы и чистим если не создались; O_CLOEXEC - exec сам закроет чужие концы
+        if (pipe2(pipes[i], O_CLOEXEC) < 0) {
             perror("pipe");
 
             for (int k = 0; k < i; k++) { 
@@ -367,20 +639,50 @@ int execute_pipeline_node(ASTNode *node) {
             free(pipe_stderr);
             return 1;
         }
+        if (pipe_size > 0 && fcntl(pipes[i][1], F_SETPIPE_SZ, (int)pipe_size) < 0) {
+            perror("F_SETPIPE_SZ");
+        }
     }
 
+    // все концы пайпов по возрастанию: ребенку с кодом шелла хватит close_range на каждый непрерывный участок
+    int *pipe_fds = sorted_pipe_fds(pipes, pipes_count);
+
+    // последняя стадия - встроенная без побочных эффектов (помечает optimize):
+    // она выполняется в самом шелле после запуска остальных, без fork
+    ASTNode *last = stages[count_command - 1];
+    int in_shell = !background && last && last->type == NODE_COMMAND && last->command.pure;
+    int nproc = count_command - in_shell;
+
+    // тела here-document и помощники multios всех стадий готовим до fork (при ошибке стадия сообщит о ней сама)
+    for (int i = 0; i < nproc; i++) {
+        prepare_heredocs(stage_redir(stages[i]));
+        multios_prepare(stage_redir(stages[i]));
+    }
+
+    JobLimits bg_limits;
+    memset(&bg_limits, 0, sizeof(bg_limits));
+    if (background) limits_background(&bg_limits); // set -o bgnice
+
+    // своя группа - только для заданий; без управления заданиями стадии остаются в группе шелла
+    int own_group = shell_is_interactive || background;
     pid_t pgid = 0;
 
-    for (int i = 0; i < count_command; i++) {
+    for (int i = 0; i < nproc; i++) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork");
+            for (int k = 0; k < count_command; k++) {
+                release_heredocs(stage_redir(stages[k]));
+                multios_release(stage_redir(stages[k]));
+            }
+            multios_wait(1);
             // закрываемся и освобождаем память
             for (int k = 0; k < pipes_count; k++) { 
                 close(pipes[k][0]); 
                 close(pipes[k][1]); 
             }
             free(pipes); 
+            free(pipe_fds);
             free(pids);
             free(stages); 
             free(pipe_stderr);
@@ -395,12 +697,21 @@ int execute_pipeline_node(ASTNode *node) {
             signal(SIGTTIN, SIG_DFL); // read
             signal(SIGTTOU, SIG_DFL); // write
 
-            // создаем группу процессов
-            if (i == 0){
-                setpgid(0, 0);
-            } else {
-                setpgid(0, pgid);
+            // помощники <(...) стадии остаются в её группе
+            shell_is_interactive = 0;
+
+            // set -o cpuspread: ядро стадии; "affinity" у самой стадии применится позже и перекроет
+            JobLimits spread;
+            if (limits_spread(i, &spread)) limits_apply(&spread);
+            if (background) {
+                JobLimits own;
+                command_limits(stages[i], &own);
+                limits_merge(&bg_limits, &own);
             }
+            limits_apply(&bg_limits);
+
+            // создаем группу процессов
+            if (own_group) setpgid(0, i == 0 ? 0 : pgid);
 
             // перенаправление stdin не первая команда -> читаем из pipe
             if (i > 0) {
@@ -414,10 +725,16 @@ int execute_pipeline_node(ASTNode *node) {
                 }
             }
 
-            //закрываем после дупов
-            for (int k = 0; k < pipes_count; k++) {
-                close(pipes[k][0]);
-                close(pipes[k][1]);
+            // Чужие концы закрываем всегда, а не надеемся на O_CLOEXEC: помощники,
+            // запущенные при раскрытии слов стадии (<(...), $(...)), унаследовали бы
+            // их без exec, и читатель дальше по конвейеру не увидел бы EOF
+            if (pipe_fds) {
+                close_fd_runs(pipe_fds, 2 * pipes_count);
+            } else {
+                for (int k = 0; k < pipes_count; k++) {
+                    close(pipes[k][0]);
+                    close(pipes[k][1]);
+                }
             }
 
             if (stages[i] && stages[i]->type == NODE_COMMAND) {
@@ -429,61 +746,178 @@ int execute_pipeline_node(ASTNode *node) {
         }
 
         // устанавливаем группу процессов тоже
-        if (i == 0) {
-            pgid = pid;
-            setpgid(pid, pgid);
-        } else {
-            setpgid(pid, pgid);
-        }
+        if (i == 0) pgid = pid;
+        if (own_group) setpgid(pid, pgid);
 
         pids[i] = pid;
     }
 
+    for (int i = 0; i < nproc; i++) {
+        release_heredocs(stage_redir(stages[i]));
+        multios_release(stage_redir(stages[i]));
+    }
+
     for (int k = 0; k < pipes_count; k++) {
         close(pipes[k][0]);
         close(pipes[k][1]);
     }
+
+    // терминал - стадиям до того, как шелл займется последней: иначе читающая
+    // с терминала стадия (cat | true) получит SIGTTIN и встанет. Шелл игнорирует
+    // SIGTTOU, так что вывод встроенной команды из фоновой группы проходит
+    if (shell_is_interactive && !background) tcsetpgrp(shell_terminal, pgid);
+
+    // вход ей не нужен: читать из закрытого пайпа она и так бы не стала
+    int in_shell_rc = in_shell ? execute_command(last) : 0;
  
     int rc = 0;
-
-    // Обработка конвеера
-    if (shell_is_interactive) {
+    int *codes = NULL; // коды стадий по индексу стадии
+    char *text = ast_to_string(node);
+
+    if (background) {
+        // в таблице заданий - настоящие процессы стадий и полный текст конвейера
+        Job *job = add_job(pgid, text ? text : "pipeline", JOB_RUNNING, 1);
+        for (int i = 0; i < count_command; i++) job_add_process(job, pids[i]);
+        multios_wait(0);
+
+        if (job) {
+            job->limits = bg_limits;
+            // номер задания - для человека за терминалом, в скрипте и -c он лишний
+            if (shell_is_interactive) printf("[%d] %d\n", job->id, pgid);
+        }
+        g_sh->last_bg_pgid = pids[count_command - 1]; // $! - последняя стадия, как в bash
+    } else if (shell_is_interactive) {
+        codes = calloc(count_command, sizeof(int));
 
         // конвеер как новый job, пока выполняется управление у конвеера
-        add_job(pgid, "pipeline", JOB_RUNNING, 0);
+        Job *job = add_job(pgid, text ? text : "pipeline", JOB_RUNNING, 0);
+        for (int i = 0; i < nproc; i++) job_add_process(job, pids[i]);
 
-        tcsetpgrp(shell_terminal, pgid);
-        rc = wait_foreground_pgid(pgid, pids[count_command - 1]);
-        tcsetpgrp(shell_terminal, shell_pgid);
+        rc = wait_foreground_pgid(pgid, pids[nproc - 1]);
+        terminal_to_shell(pgid);
 
         // после завершения возвращаем управление шеллу и обновляем статус
         Job *j = find_job_by_pgid(pgid);
+        if (j && codes) {
+            int i = 0;
+            for (Process *p = j->first_process; p && i < nproc; p = p->next, i++) {
+                codes[i] = p->completed ? status_code(p->status)
+                         : p->stopped ? 128 + WSTOPSIG(p->status) : 0;
+            }
+        }
+        multios_wait(!(j && j->status == JOB_STOPPED));
         if (j && j->status != JOB_STOPPED) {
             j->status = JOB_DONE;
             delete_job(pgid);
         }
     } else { // простое ожидание пока не закончится
+        codes = calloc(count_command, sizeof(int));
         int status = 0;
-        for (int i = 0; i < count_command; i++) {
-            waitpid(pids[i], &status, 0);
-            if (i == count_command - 1) {
-                if (WIFEXITED(status)) rc = WEXITSTATUS(status);
-                else if (WIFSIGNALED(status)) rc = 128 + WTERMSIG(status);
-                else rc = 1;
-            }
+        for (int i = 0; i < nproc; i++) {
+            while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR);
+            if (codes) codes[i] = status_code(status);
+            if (i == nproc - 1) rc = status_code(status);
         }
+        multios_wait(1);
+    }
+
+    if (in_shell) {
+        rc = in_shell_rc;
+        if (codes) codes[count_command - 1] = in_shell_rc;
+    }
+
+    if (codes) {
+        set_pipestatus(codes, count_command);
+        if (get_option(OPT_PIPEFAIL)) rc = pipefail_code(codes, count_command);
+        free(codes);
     }
 
+    free(text);
     free(pipes);
+    free(pipe_fds);
     free(pids);
     free(stages);
     free(pipe_stderr);
     return rc;
 }
 
+int execute_pipeline_node(ASTNode *node) {
+    return run_pipeline(node, 0);
+}
+
 int execute(ASTNode *node) {
+    test_cache_reset();
     int rc = execute_internal(node, 0);
-    g_last_status = rc;
+    g_sh->last_status = rc;
+    return rc;
+}
+
+// mybash -c: шелл больше ничего не выполнит, последняя команда заменяет процесс
+int execute_tail(ASTNode *node) {
+    test_cache_reset();
+    int rc = execute_internal(node, 1);
+    g_sh->last_status = rc;
+    return rc;
+}
+
+// ((expr)): код 0, если значение не ноль. Выражение без подстановок разбирается
+// один раз и хранится в узле, с подстановками - раскрывается и идет через кэш
+static int execute_arith(ASTNode *node) {
+    long long v = 0;
+    int err;
+
+    if (needs_expansion(node->arith.expr)) {
+        char *expr = expand_word(node->arith.expr, EXPAND_WORD);
+        if (!expr) return 1;
+        err = arith_expand(expr, &v);
+        free(expr);
+    } else {
+        if (!node->arith.prog) node->arith.prog = arith_compile(node->arith.expr);
+        err = node->arith.prog ? arith_eval(node->arith.prog, &v) : 1;
+    }
+
+    if (err) return 1;
+    return v != 0 ? 0 : 1;
+}
+
+// перенаправления группы в одноразовом процессе: восстанавливать нечего
+static int redirect_in_child(Redirection *redir) {
+    if (!redir) return 0;
+    if (expand_redirs(redir) != 0) return 1;
+    return handle_redirection(redir);
+}
+
+// { a; b; } >log: файлы открываются один раз, команды группы наследуют дескрипторы,
+// после группы шелл возвращает свои
+static int execute_group_redirected(ASTNode *node, int in_child) {
+    Redirection *redir = node->unary.redir;
+    RedirPlan *plan = &node->unary.plan;
+
+    if (in_child) {
+        if (redirect_in_child(redir) != 0) return 1;
+        return execute_internal(node->unary.child, 1);
+    }
+
+    if (expand_redirs(redir) != 0) return 1;
+
+    // всё накопленное относится к старому stdout
+    out_flush_all();
+
+    int saved[plan->n_touched > 0 ? plan->n_touched : 1];
+    if (save_redir_fds(plan, saved) != 0) return 1;
+
+    int rc = 1;
+    if (handle_redirection(redir) == 0) {
+        rc = execute_internal(node->unary.child, 0);
+    }
+
+    // вывод встроенных команд группы - в перенаправленный файл, пока он на месте
+    out_flush_all();
+    restore_redir_fds(plan, saved);
+
+    release_heredocs(redir);
+    multios_release(redir);
+    multios_wait(1);
     return rc;
 }
 
@@ -492,65 +926,92 @@ int execute_internal(ASTNode *node, int in_child) {
 
     switch (node->type) {
         //выполнение команды
-        case NODE_COMMAND:
+        case NODE_COMMAND: {
             if (in_child) {
                 exec_command_in_child(node);
                 return 1;
             }
-            return execute_command(node);
+            int rc = execute_command(node);
+            set_pipestatus(&rc, 1);
+            return rc;
+        }
 
         // для двух пайпов перенаправляем
         case NODE_PIPE:
         case NODE_PIPE_STDERR:
             return execute_pipeline_node(node);
 
+        // in_child - узел последний в одноразовом процессе (подоболочка, стадия, -c):
+        // его простая команда делает exec без fork. Левая часть списков не последняя,
+        // поэтому идет обычным путем с fork и ожиданием
+
         // последовательное выполнение - код выходной левой команды не запоминаем
         case NODE_SEQUENCE:
-            (void)execute_internal(node->binary.left, in_child);
+            g_sh->last_status = execute_internal(node->binary.left, 0); // для $? в правой части
+            if (g_sh->exited) return g_sh->last_status;
             return execute_internal(node->binary.right, in_child);
 
         // сначала левую, потом правую
         case NODE_AND: {
-            int l = execute_internal(node->binary.left, in_child);
+            int l = execute_internal(node->binary.left, 0);
+            g_sh->last_status = l;
+            if (g_sh->exited) return l;
             if (l == 0) return execute_internal(node->binary.right, in_child);
             return l;
         }
 
         // или левую или правую
         case NODE_OR: {
-            int l = execute_internal(node->binary.left, in_child);
+            int l = execute_internal(node->binary.left, 0);
+            g_sh->last_status = l;
+            if (g_sh->exited) return l;
             if (l != 0) return execute_internal(node->binary.right, in_child);
             return l;
         }
         // фонове задание
         case NODE_BACKGROUND: {
+            ASTNode *child = node->unary.child;
+
+            // конвейер запускаем прямо отсюда, без промежуточной копии шелла.
+            // Помощники multios - дети шелла вне группы задания, их дожидается только копия
+            if (child && (child->type == NODE_PIPE || child->type == NODE_PIPE_STDERR) &&
+                !pipeline_has_multios(child)) {
+                return run_pipeline(child, 1);
+            }
+
+            test_cache_reset();
+            out_flush_all();
             //дочерка
+            JobLimits bg_limits, own;
+            limits_background(&bg_limits); // set -o bgnice
+            command_limits(child, &own);
+            limits_merge(&bg_limits, &own); // для jobs -l - то же, что применено
+
             pid_t pid = fork(); //делаем лидером собственной группы процессов
             if (pid == 0) { 
                 setpgid(0, 0);
+                limits_apply(&bg_limits);
+                shell_is_interactive = 0; // команды внутри не трогают терминал и остаются в группе
 
                 signal(SIGINT, SIG_DFL);
                 signal(SIGQUIT, SIG_DFL); // востанавливаем обработки сигналов
                 signal(SIGTSTP, SIG_DFL);
-                _exit(execute_internal(node->unary.child, 1)); // выполнили и ушли
+                _exit(execute_internal(child, 1)); // выполнили и ушли
             // родительский
             } else if (pid > 0) { 
                 setpgid(pid, pid); // устанавливаем группу в родителе
 
-                // имя для jobs
-                const char *cmd_name = "background"; 
-                if (node->unary.child && node -> unary.child -> type == NODE_COMMAND 
-                                      && node -> unary.child -> command.argv &&
-                                         node -> unary.child -> command.argv[0]) {
-
-                    cmd_name = node->unary.child->command.argv[0];
-                }
+                // полный текст команды для jobs
+                char *text = ast_to_string(child);
+                Job *j = add_job(pid, text ? text : "background", JOB_RUNNING, 1); // делаем новое фон задание
+                job_add_process(j, pid);
+                free(text);
 
-                add_job(pid, cmd_name, JOB_RUNNING, 1); // делаем новое фон задание
-                g_last_bg_pgid = pid; // для переменной $!
+                // для jobs -l: bgnice и ограничения из "limit ... &"
+                if (j) j->limits = bg_limits;
+                g_sh->last_bg_pgid = pid; // для переменной $!
 
-                Job *j = find_job_by_pgid(pid);
-                if (j) printf("[%d] %d\n", j->id, pid); //вывод найденной работы
+                if (j && shell_is_interactive) printf("[%d] %d\n", j->id, pid); //вывод найденной работы
 
                 return 0;
             } else {
@@ -560,19 +1021,58 @@ int execute_internal(ASTNode *node, int in_child) {
         }
         // ( (cmd) )
         case NODE_SUB: {
+            // уже в одноразовом процессе: изоляция есть, второй fork не нужен
+            if (in_child) {
+                if (redirect_in_child(node->unary.redir) != 0) return 1;
+                return execute_internal(node->unary.child, 1);
+            }
+
+            test_cache_reset();
+            out_flush_all();
             pid_t pid = fork();
             // дочерка
             if (pid == 0) {
+                // подоболочка - отдельное задание, команды внутри живут в её группе
+                if (shell_is_interactive) {
+                    setpgid(0, 0);
+                    tcsetpgrp(shell_terminal, getpid());
+                }
+                shell_is_interactive = 0;
+
+                signal(SIGINT, SIG_DFL);
+                signal(SIGQUIT, SIG_DFL);
+                signal(SIGTSTP, SIG_DFL);
+                signal(SIGTTIN, SIG_DFL);
+                signal(SIGTTOU, SIG_DFL);
+
+                if (redirect_in_child(node->unary.redir) != 0) _exit(1);
                 _exit(execute_internal(node->unary.child, 1)); // выполняем и выходим
                 // изменения внутри () не влияют на шелл
             } else if (pid > 0) {
-                // у родителя ждем завершения и разбираем код возврата
-                int status;
-                waitpid(pid, &status, 0);
+                int rc;
+                if (shell_is_interactive) {
+                    setpgid(pid, pid);
+
+                    char *text = ast_to_string(node);
+                    Job *job = add_job(pid, text ? text : "subshell", JOB_RUNNING, 0);
+                    job_add_process(job, pid);
+                    free(text);
+
+                    tcsetpgrp(shell_terminal, pid);
+                    rc = wait_foreground_pgid(pid, pid);
+                    terminal_to_shell(pid);
+
+                    Job *j = find_job_by_pgid(pid);
+                    if (j && j->status != JOB_STOPPED) delete_job(pid);
+                } else {
+                    // у родителя ждем завершения и разбираем код возврата
+                    int status;
+                    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+                    rc = status_code(status);
+                }
 
-                if (WIFEXITED(status)) return WEXITSTATUS(status);
-                if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
-                return 1;
+                set_pipestatus(&rc, 1);
+                return rc;
             } else {
                 perror("fork subshell");
                 return 1;
@@ -580,8 +1080,15 @@ int execute_internal(ASTNode *node, int in_child) {
         }
 
         case NODE_GROUP:
+            if (node->unary.redir) return execute_group_redirected(node, in_child);
             return execute_internal(node->unary.child, in_child); // команды в {} влияют на шелл, обрабатываем 
 
+        case NODE_ARITH: {
+            int rc = execute_arith(node);
+            set_pipestatus(&rc, 1);
+            return rc;
+        }
+
         default:
             fprintf(stderr, "execute: unknown node type\n");
             return 1;
@@ -589,29 +1096,74 @@ int execute_internal(ASTNode *node, int in_child) {
 }
 
 
+// закрываем концы пайпов <(...) в шелле; wait - дождаться помощников самим
+static void finish_procsubst(int wait) {
+    pid_t *pids = NULL;
+    int n = procsubst_release(&pids);
+    if (wait) procsubst_wait(pids, n);
+    free(pids);
+}
+
 int execute_command(ASTNode *node) {
     char **argv = node->command.argv;
 
     if (!argv || !argv[0]) return 0; 
 
-    // расширяем переменные окружения в аргументах 
-    expand_argv(argv);
+    // расширяем переменные и подстановки в аргументах 
+    if (expand_command(node) != 0) {
+        finish_procsubst(1);
+        return 1;
+    }
+    argv = node->command.argv;
+    if (!argv[0]) {
+        finish_procsubst(1);
+        return 0;
+    }
 
     // встроенная ли команда
     if (is_builtin(argv[0])) {
-        return run_builtin_with_redir(node);
+        int rc = run_builtin_with_redir(node);
+        release_heredocs(node->command.redir);
+        multios_release(node->command.redir);
+        multios_wait(1);
+        if (rc != BUILTIN_DEFER) {
+            finish_procsubst(1);
+            return rc;
+        }
+    }
+
+    // тела here-document и помощники multios готовы до fork
+    if (prepare_heredocs(node->command.redir) != 0 || multios_prepare(node->command.redir) != 0) {
+        release_heredocs(node->command.redir);
+        finish_procsubst(1);
+        return 1;
+    }
+
+    // помощники <(...) уже создали группу - команда встает в неё же
+    pid_t job_pgid = procsubst_pgid();
+
+    test_cache_reset();
+    out_flush_all(); // иначе ребенок унаследует недописанный буфер
+
+    // set -o zygote: порождает помощник, он же ставит ребенка в группу job_pgid
+    pid_t pid = zygote_spawn(node, job_pgid);
+    if (pid < 0) {
+        release_heredocs(node->command.redir);
+        multios_release(node->command.redir);
+        multios_wait(1);
+        finish_procsubst(1);
+        return 1;
     }
 
     // создаем новый дочерний процесс для выполнения внешней команды
-    pid_t pid = fork();
+    if (pid == 0) pid = fork();
     
     if (pid == 0) {  
-        // дочерний процесс лидером своей группы процессов
-        setpgid(0, 0);
-
         if (shell_is_interactive) {  // Если работаем в интерактивном режиме, передаем управление
-    
-            tcsetpgrp(shell_terminal, getpid());
+            // дочерний процесс лидером своей группы процессов (или в группу помощников);
+            // без управления заданиями команда остается в группе шелла
+            setpgid(0, job_pgid);
+            tcsetpgrp(shell_terminal, job_pgid ? job_pgid : getpid());
             
             // Восстанавливаем стандартную обработку сигналов 
             signal(SIGINT, SIG_DFL);  
@@ -624,34 +1176,44 @@ int execute_command(ASTNode *node) {
         if (handle_redirection(node->command.redir) != 0) 
             _exit(1);  // Выход с кодом ошибки при проблеме с перенаправлением
 
+        procsubst_exec_prepare();
         execvp(argv[0], argv);
         
-        fprintf(stderr, "%s: command not found\\n", argv[0]);
+        fprintf(stderr, "%s: command not found\n", argv[0]);
         _exit(127); 
 
     } else if (pid > 0) {  // Код родительского процесса (shell)
-        // помещаем дочерний процесс в его собственную группу
-        // вызываем и в родителе, и в ребенке
-        setpgid(pid, pid);
+        release_heredocs(node->command.redir);
+        multios_release(node->command.redir);
 
         if (shell_is_interactive) {  
+            // помещаем дочерний процесс в его собственную группу
+            // вызываем и в родителе, и в ребенке
+            if (!job_pgid) job_pgid = pid;
+            setpgid(pid, job_pgid);
+
+            // помощников дождется wait_foreground_pgid: они в той же группе
+            finish_procsubst(0);
+
             // добавляем команду в список заданий
             
-            add_job(pid, argv[0], JOB_RUNNING, 0);
+            Job *job = add_job(job_pgid, argv[0], JOB_RUNNING, 0);
+            job_add_process(job, pid);
 
-            tcsetpgrp(shell_terminal, pid);
+            tcsetpgrp(shell_terminal, job_pgid);
             
             // ждем завершения/приостановки команды
-            int rc = wait_foreground_pgid(pid, pid);
+            int rc = wait_foreground_pgid(job_pgid, pid);
             
-            //возвращаем управление терминалом shell'у
-            tcsetpgrp(shell_terminal, shell_pgid);
+            //возвращаем управление терминалом shell'у (и его режимы)
+            terminal_to_shell(job_pgid);
 
             // find_job_by_pgid: ищем задание в списке
-            Job *j = find_job_by_pgid(pid);
+            Job *j = find_job_by_pgid(job_pgid);
+            multios_wait(!(j && j->status == JOB_STOPPED));
             if (j && j->status != JOB_STOPPED) {
                 j->status = JOB_DONE;  
-                delete_job(pid);        
+                delete_job(job_pgid);        
             }
 
             return rc;  // Возвращаем код возврата команды
@@ -659,6 +1221,8 @@ int execute_command(ASTNode *node) {
         } else {  // Неинтерактивный режим
             int status;  
             waitpid(pid, &status, 0);
+            finish_procsubst(1);
+            multios_wait(1);
             
            
             if (WIFEXITED(status)) 
@@ -673,6 +1237,10 @@ int execute_command(ASTNode *node) {
         
     } else { 
         perror("fork failed");  
+        release_heredocs(node->command.redir);
+        multios_release(node->command.redir);
+        multios_wait(1);
+        finish_procsubst(1);
         return 1;  
     }
 }
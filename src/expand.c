@@ -0,0 +1,588 @@
+#define _GNU_SOURCE
+
+#include "../inc/expand.h"
+#include "../inc/lexer.h"
+#include "../inc/parser.h"
+#include "../inc/execution.h"
+#include "../inc/builtin.h"
+#include "../inc/outbuf.h"
+#include "../inc/procsubst.h"
+#include "../inc/arith.h"
+#include "../inc/optimize.h"
+#include "../inc/shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern int shell_is_interactive;
+
+// Раскрытие слов: $VAR, ${VAR}, $?, $$, $!, $((...)), $(...), `...` и <(...) / >(...).
+// Параллельно с текстом ведем маску: символы из раскрытий без кавычек можно делить на поля.
+
+#define CAPTURE_READ (64 * 1024)
+
+typedef struct {
+    char *data;
+    char *split;
+    size_t len;
+    size_t cap;
+    int has_literal;  // в слове есть что-то кроме раскрытий без кавычек
+    int has_unquoted; // было раскрытие без кавычек
+    int failed;       // ошибка раскрытия (например, в $((...))) - команда не выполняется
+} ExpBuf;
+
+static int eb_reserve(ExpBuf *b, size_t add) {
+    if (b->len + add + 1 <= b->cap) return 0;
+
+    size_t cap = b->cap ? b->cap : 64;
+    while (b->len + add + 1 > cap) cap *= 2;
+
+    char *data = realloc(b->data, cap);
+    if (!data) return -1;
+    b->data = data;
+
+    char *split = realloc(b->split, cap);
+    if (!split) return -1;
+    b->split = split;
+
+    b->cap = cap;
+    return 0;
+}
+
+static void eb_append(ExpBuf *b, const char *s, size_t n, int splittable) {
+    if (eb_reserve(b, n) < 0) return;
+    memcpy(b->data + b->len, s, n);
+    memset(b->split + b->len, splittable, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+static void eb_putc(ExpBuf *b, char c) {
+    b->has_literal = 1;
+    eb_append(b, &c, 1, 0);
+}
+
+// результат раскрытия: без кавычек - делится на поля, в кавычках - нет
+static void eb_expansion(ExpBuf *b, const char *s, size_t n, int quoted) {
+    if (quoted) {
+        b->has_literal = 1;
+    } else {
+        b->has_unquoted = 1;
+    }
+    eb_append(b, s, n, !quoted);
+}
+
+int needs_expansion(const char *s) {
+    return s && strpbrk(s, "$`\001\002\003") != NULL;
+}
+
+static int status_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+
+// ---------- подстановка команд ----------
+
+static void free_words(char **argv) {
+    if (!argv) return;
+    for (char **w = argv; *w; ++w) free(*w);
+    free(argv);
+}
+
+// Встроенная команда без побочных эффектов выполняется прямо в шелле,
+// её вывод перехватывается буфером stdout. Годится ли команда, решаем по
+// нераскрытому имени, а раскрываем копию слов: дерево остается нетронутым,
+// и capture_fork раскроет его ровно один раз. Если утилита отказалась,
+// уже раскрытые слова возвращаются в *deferred - их запускают без повторного раскрытия
+static char *capture_in_process(ASTNode *ast, size_t *len, int *ok, char ***deferred) {
+    *ok = 0;
+    *deferred = NULL;
+    if (ast->type != NODE_COMMAND || ast->command.redir) return NULL;
+
+    const char *name = ast->command.argv[0];
+    if (!name || needs_expansion(name)) return NULL;
+    const Builtin *b = find_builtin(name);
+    if (!b || !(b->flags & BUILTIN_NOFORK)) return NULL;
+
+    ASTNode tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.type = NODE_COMMAND;
+    tmp.command.argc = ast->command.argc;
+    tmp.command.argv = calloc(ast->command.argc + 1, sizeof(char *));
+    if (!tmp.command.argv) return NULL;
+    for (int i = 0; i < ast->command.argc; ++i) {
+        tmp.command.argv[i] = strdup(ast->command.argv[i]);
+        if (!tmp.command.argv[i]) {
+            free_words(tmp.command.argv);
+            return NULL;
+        }
+    }
+
+    if (expand_command(&tmp) != 0) {
+        free_words(tmp.command.argv);
+        g_sh->last_status = 1;
+        *ok = 1;
+        return strdup("");
+    }
+
+    OutCapture saved;
+    out_capture_begin(&saved);
+    int rc = run_builtin(tmp.command.argv);
+    char *data = out_capture_end(&saved, len);
+
+    // утилита отказалась (неизвестная опция) - пусть работает внешняя программа
+    if (rc == BUILTIN_DEFER) {
+        free(data);
+        *deferred = tmp.command.argv;
+        return NULL;
+    }
+
+    free_words(tmp.command.argv);
+    g_sh->last_status = rc;
+    *ok = 1;
+    return data;
+}
+
+// всё остальное - в дочернем процессе, вывод читаем из пайпа крупными кусками.
+// argv - уже раскрытые слова отказавшейся утилиты, их только запускаем
+static char *capture_fork(ASTNode *ast, char **argv, size_t *len) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        out_perror("pipe");
+        return NULL;
+    }
+
+    out_flush_all();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        out_perror("fork");
+        close(p[0]);
+        close(p[1]);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        // подоболочка без управления заданиями
+        shell_is_interactive = 0;
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+
+        dup2(p[1], STDOUT_FILENO);
+        if (argv) {
+            procsubst_exec_prepare();
+            execvp(argv[0], argv);
+            fprintf(stderr, "%s: command not found\n", argv[0]);
+            _exit(127);
+        }
+        _exit(execute_internal(ast, 1));
+    }
+
+    close(p[1]);
+
+    size_t cap = CAPTURE_READ, n = 0;
+    char *data = malloc(cap + 1);
+
+    while (data) {
+        if (cap - n < CAPTURE_READ / 2) {
+            char *tmp = realloc(data, cap * 2 + 1);
+            if (!tmp) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = tmp;
+            cap *= 2;
+        }
+
+        ssize_t r = read(p[0], data + n, cap - n);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (r == 0) break;
+        n += r;
+    }
+    close(p[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    g_sh->last_status = status_code(status);
+
+    *len = n;
+    return data;
+}
+
+// выполняет cmd и возвращает его вывод без завершающих переводов строки
+char *command_substitution(const char *cmd, size_t *len) {
+    *len = 0;
+
+    Token *tokens = tokenize(cmd);
+    if (!tokens) return strdup("");
+
+    ASTNode *ast = optimize_ast(parse(tokens));
+    char *data = NULL;
+    size_t n = 0;
+
+    if (ast) {
+        int ok = 0;
+        char **deferred;
+        data = capture_in_process(ast, &n, &ok, &deferred);
+        if (!ok) data = capture_fork(ast, deferred, &n);
+        free_words(deferred);
+        free_ast(ast);
+    }
+    free_tokens(tokens);
+
+    if (!data) return strdup("");
+
+    // хвостовые переводы строки просто отрезаем, без копирования
+    while (n > 0 && data[n - 1] == '\n') n--;
+    data[n] = '\0';
+
+    *len = n;
+    return data;
+}
+
+
+// ---------- переменные ----------
+
+static int is_name_char(char c, int first) {
+    return c == '_' || isalpha((unsigned char)c) || (!first && isdigit((unsigned char)c));
+}
+
+// k-е слово значения (с 0); за последним словом - пустая строка
+static const char *nth_word(const char *val, long k, size_t *len) {
+    const char *p = val;
+    size_t wlen = 0;
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        wlen = strcspn(p, " \t\n");
+        if (k-- == 0 || !*p) break;
+        p += wlen;
+        wlen = 0;
+    }
+    *len = wlen;
+    return p;
+}
+
+// ${PIPESTATUS[i]}, [@] и [*] - все коды через пробел. Без индекса,
+// как у массива в bash, $PIPESTATUS - это ${PIPESTATUS[0]}
+static void expand_pipestatus(ExpBuf *b, const char *idx, size_t idx_len, int quoted) {
+    char buf[16];
+    int all = idx_len == 1 && (idx[0] == '@' || idx[0] == '*');
+    long k = idx ? strtol(idx, NULL, 10) : 0;
+
+    eb_expansion(b, "", 0, quoted); // "${PIPESTATUS[9]}" - пустое слово, а не ничего
+    for (int i = 0; i < g_sh->pipestatus_n; ++i) {
+        if (!all && i != k) continue;
+        int len = snprintf(buf, sizeof(buf), all && i ? " %d" : "%d", g_sh->pipestatus[i]);
+        eb_expansion(b, buf, (size_t)len, quoted);
+    }
+}
+
+static void expand_param(ExpBuf *b, const char *name, size_t name_len, int quoted) {
+    char buf[32];
+    const char *rep = NULL;
+
+    if (name_len == 1 && name[0] == '?') { // код возврата последней команды
+        snprintf(buf, sizeof(buf), "%d", g_sh->last_status);
+        rep = buf;
+    } else if (name_len == 1 && name[0] == '$') { // пид текущего процесса
+        snprintf(buf, sizeof(buf), "%d", (int)getpid());
+        rep = buf;
+    } else if (name_len == 1 && name[0] == '!') { // пид последного фонового процесса
+        snprintf(buf, sizeof(buf), "%d", (int)g_sh->last_bg_pgid);
+        rep = buf;
+    } else if (name_len >= 10 && memcmp(name, "PIPESTATUS", 10) == 0 &&
+               (name_len == 10 || (name[10] == '[' && name[name_len - 1] == ']'))) {
+        expand_pipestatus(b, name_len > 10 ? name + 11 : NULL, name_len > 10 ? name_len - 12 : 0, quoted);
+        return;
+    } else if (name_len > 2 && name[name_len - 1] == ']' && memchr(name, '[', name_len)) {
+        // ${NAME[i]} - i-е слово значения, [@] и [*] - всё значение
+        const char *br = memchr(name, '[', name_len);
+        char *key = strndup(name, (size_t)(br - name));
+        const char *val = key ? getenv(key) : NULL;
+        free(key);
+
+        const char *idx = br + 1;
+        size_t idx_len = name_len - (size_t)(idx - name) - 1;
+        if (val && idx_len == 1 && (idx[0] == '@' || idx[0] == '*')) {
+            rep = val;
+        } else if (val) {
+            size_t wlen;
+            const char *p = nth_word(val, strtol(idx, NULL, 10), &wlen);
+            eb_expansion(b, p, wlen, quoted);
+            return;
+        }
+    } else { // переменная окружения
+        char *key = strndup(name, name_len);
+        if (key) {
+            rep = getenv(key);
+            free(key);
+        }
+    }
+
+    if (!rep) rep = "";
+    eb_expansion(b, rep, strlen(rep), quoted);
+}
+
+
+// ---------- арифметика ----------
+
+// $((a) + (b)) - арифметика, $((a); (b)) - подстановка команды с подоболочками
+static int is_arith(const char *s, size_t n) {
+    int depth = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '(') depth++;
+        if (s[i] == ')' && --depth < 0) return 0;
+    }
+    return depth == 0;
+}
+
+static void expand_arith(ExpBuf *b, const char *s, size_t n, int quoted) {
+    char *text = strndup(s, n);
+    if (!text) {
+        b->failed = 1;
+        return;
+    }
+
+    // $x внутри раскрываем заранее, голые имена переменных читает сам вычислитель
+    if (needs_expansion(text)) {
+        char *exp = expand_word(text, EXPAND_WORD);
+        free(text);
+        if (!exp) {
+            b->failed = 1;
+            return;
+        }
+        text = exp;
+    }
+
+    long long v;
+    if (arith_expand(text, &v) != 0) {
+        b->failed = 1;
+        g_sh->last_status = 1;
+    } else {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%lld", v);
+        eb_expansion(b, buf, (size_t)len, quoted);
+    }
+    free(text);
+}
+
+
+// ---------- раскрытие слова ----------
+
+static void expand_core(const char *w, int mode, ExpBuf *b) {
+    int quoted = (mode == EXPAND_HEREDOC);
+
+    // <(cmd) / >(cmd) - всё слово заменяется путем /dev/fd/N
+    if (w[0] == LEX_PROCSUBST) {
+        size_t n = strlen(w + 1);
+        char *inner = strndup(w + 3, n > 3 ? n - 3 : 0);
+        char *path = inner ? procsubst_open(inner, w[1] == '>') : NULL;
+        if (path) eb_expansion(b, path, strlen(path), 1);
+        free(path);
+        free(inner);
+        return;
+    }
+
+    if (w[0] == LEX_QUOTED) {
+        quoted = 1;
+        b->has_literal = 1;
+        w++;
+    }
+
+    for (size_t i = 0; w[i]; ) {
+        char c = w[i];
+
+        if (c == LEX_ESC && w[i + 1]) {
+            eb_putc(b, w[i + 1]);
+            i += 2;
+            continue;
+        }
+
+        if (mode == EXPAND_HEREDOC && c == '\\' && w[i + 1]) {
+            char e = w[i + 1];
+            if (e == '$' || e == '`' || e == '\\') {
+                eb_putc(b, e);
+                i += 2;
+                continue;
+            }
+            if (e == '\n') { // продолжение строки
+                i += 2;
+                continue;
+            }
+        }
+
+        // `cmd`: внутри \\ \` \$ означают сам символ
+        if (c == '`') {
+            size_t n = subst_len(w, i);
+            if (n == 0) {
+                eb_putc(b, c);
+                i++;
+                continue;
+            }
+
+            char *inner = malloc(n);
+            size_t k = 0;
+            for (size_t j = i + 1; inner && j < i + n - 1; ++j) {
+                if (w[j] == '\\' && (w[j + 1] == '\\' || w[j + 1] == '`' || w[j + 1] == '$')) j++;
+                inner[k++] = w[j];
+            }
+            if (inner) {
+                inner[k] = '\0';
+                size_t out_len = 0;
+                char *out = command_substitution(inner, &out_len);
+                if (out) eb_expansion(b, out, out_len, quoted);
+                free(out);
+                free(inner);
+            }
+            i += n;
+            continue;
+        }
+
+        if (c != '$') {
+            eb_putc(b, c);
+            i++;
+            continue;
+        }
+
+        // $((...)) - арифметика, если скобки внутри сбалансированы
+        if (w[i + 1] == '(' && w[i + 2] == '(') {
+            size_t n = subst_len(w, i);
+            if (n >= 5 && w[i + n - 2] == ')' && is_arith(w + i + 3, n - 5)) {
+                expand_arith(b, w + i + 3, n - 5, quoted);
+                i += n;
+                continue;
+            }
+        }
+
+        // $(...)
+        if (w[i + 1] == '(') {
+            size_t n = subst_len(w, i);
+            if (n == 0) {
+                eb_putc(b, c);
+                i++;
+                continue;
+            }
+
+            char *inner = strndup(w + i + 2, n - 3);
+            if (inner) {
+                size_t out_len = 0;
+                char *out = command_substitution(inner, &out_len);
+                if (out) eb_expansion(b, out, out_len, quoted);
+                free(out);
+                free(inner);
+            }
+            i += n;
+            continue;
+        }
+
+        // ${NAME}
+        if (w[i + 1] == '{') {
+            const char *close = strchr(w + i + 2, '}');
+            if (!close) {
+                eb_putc(b, c);
+                i++;
+                continue;
+            }
+            expand_param(b, w + i + 2, (size_t)(close - (w + i + 2)), quoted);
+            i = (size_t)(close - w) + 1;
+            continue;
+        }
+
+        // $? $$ $!
+        if (w[i + 1] == '?' || w[i + 1] == '$' || w[i + 1] == '!') {
+            expand_param(b, w + i + 1, 1, quoted);
+            i += 2;
+            continue;
+        }
+
+        // $NAME
+        if (is_name_char(w[i + 1], 1)) {
+            size_t j = i + 1;
+            while (is_name_char(w[j], 0)) j++;
+            expand_param(b, w + i + 1, j - i - 1, quoted);
+            i = j;
+            continue;
+        }
+
+        // одинокий $
+        eb_putc(b, c);
+        i++;
+    }
+}
+
+// раскрытие без деления на поля (имена файлов, here-document)
+char *expand_word(const char *w, int mode) {
+    ExpBuf b = { 0 };
+    expand_core(w, mode, &b);
+    free(b.split);
+
+    if (b.failed) {
+        free(b.data);
+        return NULL;
+    }
+    if (!b.data) return strdup("");
+    return b.data;
+}
+
+// раскрытие с делением на поля по пробелам; *fields - новый массив строк
+int expand_fields(const char *w, char ***fields, int *n) {
+    ExpBuf b = { 0 };
+    expand_core(w, EXPAND_WORD, &b);
+
+    if (b.failed) {
+        free(b.data);
+        free(b.split);
+        *fields = NULL;
+        *n = 0;
+        return 1;
+    }
+
+    int cap = 4, cnt = 0;
+    char **out = malloc(sizeof(char *) * cap);
+    if (!out) {
+        free(b.data);
+        free(b.split);
+        return 1;
+    }
+
+    size_t i = 0;
+    while (i < b.len) {
+        // пропускаем разделители, пришедшие из раскрытия
+        while (i < b.len && b.split[i] && isspace((unsigned char)b.data[i])) i++;
+        if (i >= b.len) break;
+
+        size_t start = i;
+        while (i < b.len && !(b.split[i] && isspace((unsigned char)b.data[i]))) i++;
+
+        if (cnt >= cap) {
+            cap *= 2;
+            char **tmp = realloc(out, sizeof(char *) * cap);
+            if (!tmp) break;
+            out = tmp;
+        }
+        out[cnt++] = strndup(b.data + start, i - start);
+    }
+
+    // пустое слово остается, если в нём было что-то кроме раскрытий без кавычек ("" или '')
+    if (cnt == 0 && !(b.has_unquoted && !b.has_literal)) {
+        out[cnt++] = strdup("");
+    }
+
+    free(b.data);
+    free(b.split);
+    *fields = out;
+    *n = cnt;
+    return 0;
+}
@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+
+#include "../inc/history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_FILE ".mybash_history"
+
+// ячейка хеш-таблицы триграмм: key = триграмма + 1 (0 - пусто)
+typedef struct {
+    uint32_t key;
+    uint32_t last;   // последняя учтенная запись + 1, чтобы запись попала в список один раз
+    uint32_t count;
+    uint32_t start;  // список записей в postings[start .. start + count)
+} TriSlot;
+
+static char *hist_path = NULL;
+
+// журнал с диска: отображение и границы строк (off[i] - начало i-й, off[n] - конец)
+static const char *map = NULL;
+static size_t map_len = 0;
+static size_t *off = NULL;
+static size_t file_n = 0;
+static int split_done = 0;
+
+// раскодированная запись журнала с '\\' (history_entry)
+static char *dec = NULL;
+static size_t dec_cap = 0;
+
+// команды этой сессии
+static char **sess = NULL;
+static size_t sess_n = 0;
+static size_t sess_cap = 0;
+
+// триграммный индекс по записям журнала
+static TriSlot *tri = NULL;
+static size_t tri_mask = 0;
+static int tri_bits = 0;
+static uint32_t *postings = NULL;
+static int index_done = 0;
+
+int history_open(const char *path) {
+    history_close();
+
+    if (!path) path = getenv("HISTFILE");
+    if (path && !path[0]) return 0; // HISTFILE= - история только в памяти
+
+    if (path) {
+        hist_path = strdup(path);
+    } else {
+        const char *home = getenv("HOME");
+        if (!home) return 0;
+        if (asprintf(&hist_path, "%s/%s", home, HISTORY_FILE) < 0) hist_path = NULL;
+    }
+    if (!hist_path) return 1;
+
+    int fd = open(hist_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return 0; // файл появится с первой командой
+        perror(hist_path);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            perror(hist_path);
+        } else {
+            map = p;
+            map_len = st.st_size;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+void history_close(void) {
+    if (map) munmap((void *)map, map_len);
+    map = NULL;
+    map_len = 0;
+    free(off);
+    off = NULL;
+    file_n = 0;
+    split_done = 0;
+
+    for (size_t i = 0; i < sess_n; ++i) free(sess[i]);
+    free(sess);
+    sess = NULL;
+    sess_n = sess_cap = 0;
+
+    free(tri);
+    free(postings);
+    tri = NULL;
+    postings = NULL;
+    tri_mask = 0;
+    tri_bits = 0;
+    index_done = 0;
+
+    free(dec);
+    dec = NULL;
+    dec_cap = 0;
+
+    free(hist_path);
+    hist_path = NULL;
+}
+
+// делим журнал на строки при первом обращении
+static void split_file(void) {
+    if (split_done) return;
+    split_done = 1;
+    if (!map) return;
+
+    size_t n = 0;
+    for (const char *p = map, *end = map + map_len; p < end; ++n) {
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+
+    off = malloc(sizeof(size_t) * (n + 1));
+    if (!off) return;
+
+    size_t i = 0;
+    for (const char *p = map, *end = map + map_len; p < end; ++i) {
+        off[i] = p - map;
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    off[n] = map_len;
+    file_n = n;
+}
+
+size_t history_count(void) {
+    split_file();
+    return file_n + sess_n;
+}
+
+// запись журнала: "\\n" - перевод строки, "\\\\" - обратная косая черта.
+// Прочие '\\' оставляем как есть
+static const char *unescape(const char *s, size_t n, size_t *len) {
+    if (n > dec_cap) {
+        char *p = realloc(dec, n);
+        if (!p) {
+            *len = n;
+            return s;
+        }
+        dec = p;
+        dec_cap = n;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '\\' && i + 1 < n && (s[i + 1] == 'n' || s[i + 1] == '\\')) {
+            dec[k++] = s[++i] == 'n' ? '\n' : '\\';
+        } else {
+            dec[k++] = s[i];
+        }
+    }
+    *len = k;
+    return dec;
+}
+
+const char *history_entry(size_t i, size_t *len) {
+    split_file();
+    if (i < file_n) {
+        size_t e = off[i + 1];
+        if (e > off[i] && map[e - 1] == '\n') e--;
+        *len = e - off[i];
+        const char *s = map + off[i];
+        // без '\\' запись отдаем прямо из отображения
+        if (memchr(s, '\\', *len)) return unescape(s, *len, len);
+        return s;
+    }
+    i -= file_n;
+    if (i >= sess_n) {
+        *len = 0;
+        return NULL;
+    }
+    *len = strlen(sess[i]);
+    return sess[i];
+}
+
+void history_add(const char *line) {
+    if (!line[0]) return;
+
+    // подряд одинаковые команды храним один раз
+    size_t n = history_count(), len;
+    if (n > 0) {
+        const char *last = history_entry(n - 1, &len);
+        if (len == strlen(line) && memcmp(last, line, len) == 0) return;
+    }
+
+    if (sess_n == sess_cap) {
+        size_t cap = sess_cap ? sess_cap * 2 : 64;
+        char **p = realloc(sess, sizeof(char *) * cap);
+        if (!p) return;
+        sess = p;
+        sess_cap = cap;
+    }
+    char *copy = strdup(line);
+    if (!copy) return;
+    sess[sess_n++] = copy;
+
+    if (!hist_path) return;
+
+    // многострочная команда - одна запись: '\n' и '\\' экранируем
+    len = strlen(line);
+    char *rec = malloc(len * 2 + 1);
+    if (!rec) return;
+    size_t k = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (line[i] == '\n' || line[i] == '\\') rec[k++] = '\\';
+        rec[k++] = line[i] == '\n' ? 'n' : line[i];
+    }
+    rec[k++] = '\n';
+
+    // запись целиком одним write: O_APPEND не даст ей смешаться с записями других шеллов
+    int fd = open(hist_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        ssize_t w;
+        while ((w = write(fd, rec, k)) < 0 && errno == EINTR);
+        close(fd);
+    }
+    free(rec);
+}
+
+// ---- триграммный индекс ----
+
+static uint32_t tri_key(const char *s) {
+    return ((uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2]) + 1;
+}
+
+static TriSlot *tri_find(uint32_t key, int insert) {
+    // старшие биты произведения: младшие зависят только от последнего байта триграммы
+    size_t i = (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> (64 - tri_bits));
+    while (tri[i].key != key) {
+        if (tri[i].key == 0) {
+            if (!insert) return NULL;
+            tri[i].key = key;
+            return &tri[i];
+        }
+        i = (i + 1) & tri_mask;
+    }
+    return &tri[i];
+}
+
+static int tri_grow(void) {
+    size_t size = tri ? (tri_mask + 1) * 2 : 1 << 16;
+    TriSlot *old = tri;
+    size_t old_size = tri ? tri_mask + 1 : 0;
+
+    tri = calloc(size, sizeof(TriSlot));
+    if (!tri) {
+        tri = old;
+        return 1;
+    }
+    tri_mask = size - 1;
+    tri_bits = old ? tri_bits + 1 : 16;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].key) *tri_find(old[i].key, 1) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Два прохода по журналу: сначала считаем длины списков, потом раскладываем номера
+// записей в один общий массив. Списки получаются отсортированными по номеру записи.
+static void build_index(void) {
+    if (index_done) return;
+    index_done = 1;
+    split_file();
+    if (file_n == 0 || file_n > UINT32_MAX - 1 || tri_grow() != 0) return;
+
+    size_t used = 0, total = 0;
+    for (size_t i = 0; i < file_n; ++i) {
+        size_t len;
+        const char *s = history_entry(i, &len);
+        for (size_t j = 0; j + 3 <= len; ++j) {
+            if (used * 2 > tri_mask && tri_grow() != 0) goto fail;
+            TriSlot *t = tri_find(tri_key(s + j), 1);
+            if (t->count == 0 && t->last == 0) used++;
+            if (t->last == i + 1) continue;
+            t->last = i + 1;
+            t->count++;
+            total++;
+        }
+    }
+
+    if (total > UINT32_MAX) goto fail;
+    postings = malloc(sizeof(uint32_t) * (total ? total : 1));
+    if (!postings) goto fail;
+
+    uint32_t start = 0;
+    for (size_t k = 0; k <= tri_mask; ++k) {
+        if (!tri[k].key) continue;
+        tri[k].start = start;
+        start += tri[k].count;
+        tri[k].count = 0;
+        tri[k].last = 0;
+    }
+
+    for (size_t i = 0; i < file_n; ++i) {
+        size_t len;
+        const char *s = history_entry(i, &len);
+        for (size_t j = 0; j + 3 <= len; ++j) {
+            TriSlot *t = tri_find(tri_key(s + j), 0);
+            if (t->last == i + 1) continue;
+            t->last = i + 1;
+            postings[t->start + t->count++] = i;
+        }
+    }
+    return;
+
+fail:
+    // без индекса поиск просто идет по всем записям
+    free(tri);
+    tri = NULL;
+    tri_mask = 0;
+    tri_bits = 0;
+}
+
+static int entry_has(size_t i, const char *pat, size_t plen) {
+    size_t len;
+    const char *s = history_entry(i, &len);
+    return s && memmem(s, len, pat, plen) != NULL;
+}
+
+// поиск по журналу через самый короткий из списков триграмм образца
+static size_t search_file(const char *pat, size_t plen, size_t before) {
+    if (before > file_n) before = file_n;
+    if (plen >= 3) build_index();
+
+    if (plen < 3 || !postings) {
+        while (before-- > 0) {
+            if (entry_has(before, pat, plen)) return before;
+        }
+        return HISTORY_NONE;
+    }
+
+    TriSlot *best = NULL;
+    for (size_t j = 0; j + 3 <= plen; ++j) {
+        TriSlot *t = tri_find(tri_key(pat + j), 0);
+        if (!t) return HISTORY_NONE; // такой триграммы нет ни в одной записи
+        if (!best || t->count < best->count) best = t;
+    }
+
+    // первый номер в списке, не меньший before
+    const uint32_t *list = postings + best->start;
+    size_t lo = 0, hi = best->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (list[mid] < before) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0) {
+        if (entry_has(list[lo], pat, plen)) return list[lo];
+    }
+    return HISTORY_NONE;
+}
+
+size_t history_search(const char *pat, size_t before) {
+    size_t plen = strlen(pat);
+    size_t n = history_count();
+    if (before > n) before = n;
+
+    // записи сессии не в индексе, их немного - смотрим подряд
+    while (before > file_n) {
+        before--;
+        if (entry_has(before, pat, plen)) return before;
+    }
+    return search_file(pat, plen, before);
+}
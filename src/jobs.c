@@ -1,4 +1,7 @@
+#define _GNU_SOURCE
+
 #include "../inc/jobs.h"
+#include "../inc/shell.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,19 +10,30 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/pidfd.h>
+#include <sys/signalfd.h>
 
-// голова связного списка фоновых заданий
-Job *first_job = NULL;
+// текущий экземпляр шелла (shell.h)
+struct MyBash *g_sh = NULL;
 
 // Параметры шелла для управления заданиями
+pid_t shell_pid;   // сам шелл, а не его дочерние процессы
 pid_t shell_pgid;
 int shell_terminal;            
 int shell_is_interactive;    
 
+// режимы терминала шелла: возвращаются каждый раз, когда шелл забирает терминал
+static struct termios shell_tmodes;
+
+
+// job_control = 0 - шелл не управляет заданиями даже на терминале (mybash -c)
+void init_shell(int job_control) {
+    shell_pid = getpid();
 
-void init_shell() {
     shell_terminal = STDIN_FILENO;
-    shell_is_interactive = isatty(shell_terminal);
+    shell_is_interactive = job_control && isatty(shell_terminal);
 
     if(shell_is_interactive) { 
         while(tcgetpgrp(shell_terminal) != (shell_pgid = getpgrp())){
@@ -34,51 +48,107 @@ void init_shell() {
 
 
         shell_pgid = getpid(); // pgid = pid
-        if(setpgid(shell_pgid, shell_pgid) < 0){ // назначаем себя лидером группы
+        // лидер сессии (шелл, запущенный прямо на терминале) уже лидер группы, setpgid ему запрещен
+        if(getpgrp() != shell_pgid && setpgid(shell_pgid, shell_pgid) < 0){ // назначаем себя лидером группы
             perror("error setpgid");
             exit(1);
         }
 
         // захватываем терминал
         tcsetpgrp(shell_terminal, shell_pgid);
+        tcgetattr(shell_terminal, &shell_tmodes);
     }
 }
 
 
-void add_job(pid_t pgid, const char *command, JobStatus status, int is_bg) {
+Job *add_job(pid_t pgid, const char *command, JobStatus status, int is_bg) {
 
     Job *jobs_list = malloc(sizeof(Job));
     if(!jobs_list){
         perror("malloc");
-        return;
+        return NULL;
     }
 
     jobs_list -> pgid = pgid;
     jobs_list -> command = strdup(command);
     jobs_list -> status = status;
     jobs_list -> is_background = is_bg;
+    memset(&jobs_list -> limits, 0, sizeof(jobs_list -> limits));
+    jobs_list -> has_tmodes = 0;
+    jobs_list -> first_process = NULL;
     jobs_list -> next = NULL;
 
     int max_id = 0;
-    Job *curr = first_job;
+    Job *curr = g_sh -> first_job;
     while (curr) {
         if(curr -> id > max_id) max_id = curr -> id;
         curr = curr -> next;
     }
     jobs_list -> id = max_id + 1;
 
-    if (!first_job) { 
-        first_job = jobs_list;
+    if (!g_sh -> first_job) { 
+        g_sh -> first_job = jobs_list;
     } else { 
-        curr = first_job;
+        curr = g_sh -> first_job;
         while (curr -> next) curr = curr -> next;
         curr -> next = jobs_list;
     } 
 
+    return jobs_list;
+}
+
+// процессы добавляются в порядке стадий, по этому порядку потом собирается PIPESTATUS
+void job_add_process(Job *job, pid_t pid) {
+    if (!job) return;
+
+    Process *p = malloc(sizeof(Process));
+    if (!p) {
+        perror("malloc");
+        return;
+    }
+    p -> next = NULL;
+    p -> pid = pid;
+    p -> pidfd = pidfd_open(pid, 0); // процесс еще не собран (мы его родитель), пид не мог смениться
+    p -> completed = 0;
+    p -> stopped = 0;
+    p -> status = 0;
+
+    Process **tail = &job -> first_process;
+    while (*tail) tail = &(*tail) -> next;
+    *tail = p;
+}
+
+// записываем статус из waitpid в процесс задания; 0 - процесс нашелся
+int mark_process_status(pid_t pid, int status) {
+    for (Job *j = g_sh -> first_job; j; j = j -> next) {
+        for (Process *p = j -> first_process; p; p = p -> next) {
+            if (p -> pid != pid) continue;
+
+            p -> status = status;
+            if (WIFSTOPPED(status)) {
+                p -> stopped = 1;
+            } else if (WIFCONTINUED(status)) {
+                p -> stopped = 0;
+            } else {
+                p -> completed = 1;
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void free_processes(Process *p) {
+    while (p) {
+        Process *next = p -> next;
+        if (p -> pidfd >= 0) close(p -> pidfd);
+        free(p);
+        p = next;
+    }
 }
 
 void delete_job(pid_t pgid) { 
-    Job *curr = first_job;
+    Job *curr = g_sh -> first_job;
     Job *prev = NULL;
 
     while (curr) {
@@ -86,9 +156,10 @@ void delete_job(pid_t pgid) {
             if (prev) {
                 prev -> next = curr -> next;
             } else {
-                first_job = curr -> next;
+                g_sh -> first_job = curr -> next;
             }
             free(curr -> command);
+            free_processes(curr -> first_process);
             free(curr);
             return;
         }
@@ -98,7 +169,7 @@ void delete_job(pid_t pgid) {
 }
 
 Job *find_job_by_pgid(pid_t pgid) { 
-    Job *jobs_list = first_job;
+    Job *jobs_list = g_sh -> first_job;
     while (jobs_list) { 
         if (jobs_list -> pgid == pgid) return jobs_list;
         jobs_list = jobs_list -> next;
@@ -107,7 +178,7 @@ Job *find_job_by_pgid(pid_t pgid) {
 }
 
 Job *find_job_by_id(int id) { 
-    Job *jobs_list = first_job;
+    Job *jobs_list = g_sh -> first_job;
     while (jobs_list) { 
         if (jobs_list -> id == id) return jobs_list;
         jobs_list = jobs_list -> next;
@@ -116,11 +187,212 @@ Job *find_job_by_id(int id) {
 }
 
 
+// ---------- ожидание через pidfd ----------
+
+// SIGCHLD читаем из signalfd: pidfd сообщает только о завершении, а остановку (Ctrl+Z) - нет
+static int chld_fd = -1;
+
+static int sigchld_fd(void) {
+    if (chld_fd < 0) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        chld_fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+    }
+    return chld_fd;
+}
+
+// статус из siginfo в формате waitpid
+static int siginfo_status(const siginfo_t *si) {
+    switch (si -> si_code) {
+        case CLD_EXITED:    return W_EXITCODE(si -> si_status, 0);
+        case CLD_KILLED:    return si -> si_status;
+        case CLD_DUMPED:    return si -> si_status | WCOREFLAG;
+        case CLD_STOPPED:
+        case CLD_TRAPPED:   return W_STOPCODE(si -> si_status);
+        default:            return 0xffff; // CLD_CONTINUED
+    }
+}
+
+// неблокирующий опрос процессов задания
+static void poll_job(Job *job) {
+    for (Process *p = job -> first_process; p; p = p -> next) {
+        if (p -> completed) continue;
+
+        siginfo_t si;
+        int r;
+        do {
+            memset(&si, 0, sizeof(si));
+            if (p -> pidfd >= 0) {
+                r = waitid(P_PIDFD, p -> pidfd, &si, WEXITED | WSTOPPED | WCONTINUED | WNOHANG);
+            } else {
+                r = waitid(P_PID, p -> pid, &si, WEXITED | WSTOPPED | WCONTINUED | WNOHANG);
+            }
+        } while (r < 0 && errno == EINTR);
+
+        if (r < 0) {
+            // процесс уже собрал кто-то другой (check_background_jobs) - статус записан там
+            if (errno == ECHILD) p -> completed = 1;
+            continue;
+        }
+        if (si.si_pid == 0) continue; // состояние не менялось
+
+        int status = siginfo_status(&si);
+        p -> status = status;
+        if (WIFSTOPPED(status)) {
+            p -> stopped = 1;
+        } else if (WIFCONTINUED(status)) {
+            p -> stopped = 0;
+        } else {
+            p -> completed = 1;
+        }
+    }
+}
+
+static int job_is_completed(Job *job) {
+    for (Process *p = job -> first_process; p; p = p -> next) {
+        if (!p -> completed) return 0;
+    }
+    return 1;
+}
+
+static int job_is_stopped(Job *job) {
+    int stopped = 0;
+    for (Process *p = job -> first_process; p; p = p -> next) {
+        if (!p -> completed && !p -> stopped) return 0;
+        if (p -> stopped) stopped = 1;
+    }
+    return stopped;
+}
+
+// код возврата задания - код его последнего процесса
+int job_exit_code(Job *job) {
+    Process *last = job -> first_process;
+    while (last && last -> next) last = last -> next;
+    if (!last) return 0;
+
+    int st = last -> status;
+    if (last -> stopped) return 128 + WSTOPSIG(st);
+    if (WIFEXITED(st)) return WEXITSTATUS(st);
+    if (WIFSIGNALED(st)) return 128 + WTERMSIG(st);
+    return 0;
+}
+
+// Ждем несколько заданий сразу: poll по pidfd всех процессов, signalfd (остановки) и
+// timer_fd (дедлайн, -1 - без него). Возвращает индекс завершившегося задания (JOB_WAIT_ANY),
+// n - все завершились, JOB_WAIT_STOPPED или JOB_WAIT_TIMEOUT.
+int jobs_wait(Job **jobs, int n, int flags, int timer_fd) {
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &old); // дети созданы до этого и маску не наследуют
+
+    int cfd = sigchld_fd();
+    int result = n;
+    struct pollfd *fds = NULL;
+    int cap = 0;
+
+    for (;;) {
+        // сначала опрос: всё, что случилось до блокировки сигнала, уже видно через waitid
+        struct signalfd_siginfo ssi;
+        while (cfd >= 0 && read(cfd, &ssi, sizeof(ssi)) > 0);
+
+        int all_done = 1, idx_done = -1, any_stopped = 0;
+        for (int i = 0; i < n; ++i) {
+            poll_job(jobs[i]);
+            if (job_is_completed(jobs[i])) {
+                jobs[i] -> status = JOB_DONE;
+                if (idx_done < 0) idx_done = i;
+            } else {
+                all_done = 0;
+                if (job_is_stopped(jobs[i])) {
+                    jobs[i] -> status = JOB_STOPPED;
+                    any_stopped = 1;
+                }
+            }
+        }
+
+        if ((flags & JOB_WAIT_ANY) && idx_done >= 0) {
+            result = idx_done;
+            break;
+        }
+        if (all_done) {
+            result = n;
+            break;
+        }
+        if ((flags & JOB_WAIT_STOP) && any_stopped) {
+            result = JOB_WAIT_STOPPED;
+            break;
+        }
+
+        // собираем дескрипторы для poll
+        int need = 2;
+        for (int i = 0; i < n; ++i) {
+            for (Process *p = jobs[i] -> first_process; p; p = p -> next) need++;
+        }
+        if (need > cap) {
+            struct pollfd *tmp = realloc(fds, sizeof(struct pollfd) * need);
+            if (!tmp) {
+                perror("realloc");
+                result = n;
+                break;
+            }
+            fds = tmp;
+            cap = need;
+        }
+
+        int nfds = 0, timer_idx = -1;
+        if (cfd >= 0) fds[nfds++] = (struct pollfd){ cfd, POLLIN, 0 };
+        if (timer_fd >= 0) {
+            timer_idx = nfds;
+            fds[nfds++] = (struct pollfd){ timer_fd, POLLIN, 0 };
+        }
+        for (int i = 0; i < n; ++i) {
+            for (Process *p = jobs[i] -> first_process; p; p = p -> next) {
+                if (!p -> completed && p -> pidfd >= 0) fds[nfds++] = (struct pollfd){ p -> pidfd, POLLIN, 0 };
+            }
+        }
+
+        if (poll(fds, nfds, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            result = n;
+            break;
+        }
+
+        if (timer_idx >= 0 && (fds[timer_idx].revents & POLLIN)) {
+            uint64_t ticks;
+            if (read(timer_fd, &ticks, sizeof(ticks)) < 0) { /* таймер уже сработал */ }
+            result = JOB_WAIT_TIMEOUT;
+            break;
+        }
+    }
+
+    free(fds);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return result;
+}
+
+
 void wait_for_job(Job *jobs_list) { 
     int status;
     pid_t pid;
 
+    // задание с известными процессами ждем через pidfd
+    if (jobs_list -> first_process) {
+        if (jobs_wait(&jobs_list, 1, JOB_WAIT_STOP, -1) == JOB_WAIT_STOPPED) {
+            jobs_list -> is_background = 1;
+            printf("\n[%d]+ Stopped %s\n", jobs_list -> id, jobs_list -> command);
+            return;
+        }
+
+        // в группе могут остаться помощники <(...) - собираем их
+        while (waitpid(-jobs_list -> pgid, &status, 0) > 0 || errno == EINTR);
+        delete_job(jobs_list -> pgid);
+        return;
+    }
+
     while ((pid = waitpid(-jobs_list -> pgid, &status, WUNTRACED)) > 0) { 
+        mark_process_status(pid, status);
         if(WIFSTOPPED(status)) { 
             jobs_list -> status = JOB_STOPPED;
             jobs_list -> is_background = 1;
@@ -142,13 +414,31 @@ void wait_for_job(Job *jobs_list) {
 }
 
 
+// отдаем терминал заданию (fg): остановленное получает свои режимы обратно
+void terminal_to_job(Job *job) {
+    if (job -> has_tmodes) tcsetattr(shell_terminal, TCSADRAIN, &job -> tmodes);
+    tcsetpgrp(shell_terminal, job -> pgid);
+}
+
+// забираем терминал у группы pgid: если задание остановилось, запоминаем его режимы,
+// а терминалу возвращаем режимы шелла - программа могла оставить raw или без эха
+void terminal_to_shell(pid_t pgid) {
+    Job *job = pgid ? find_job_by_pgid(pgid) : NULL;
+    if (job && job -> status == JOB_STOPPED && tcgetattr(shell_terminal, &job -> tmodes) == 0) {
+        job -> has_tmodes = 1;
+    }
+    tcsetpgrp(shell_terminal, shell_pgid);
+    tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
+}
+
 void check_background_jobs() {
 
-    Job *job = first_job;
+    Job *job = g_sh -> first_job;
 
     while (job) { 
+        Job *next = job -> next; // delete_job освобождает job
         if (!job -> is_background) { 
-            job = job -> next;
+            job = next;
             continue;
         }
 
@@ -158,6 +448,7 @@ void check_background_jobs() {
 
         while ((pid = waitpid(-job->pgid, &status, WNOHANG | WUNTRACED)) > 0) {
             any_change = 1;
+            mark_process_status(pid, status);
 
             if (WIFSTOPPED(status)) {
                 job->status = JOB_STOPPED;
@@ -175,6 +466,6 @@ void check_background_jobs() {
             delete_job(job->pgid);
         }
 
-        job = job -> next;
+        job = next;
     }
 }
@@ -1,5 +1,6 @@
 #include "../inc/lexer.h"
 #include "../inc/token.h"
+#include "../inc/shell.h"
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
@@ -8,7 +9,16 @@
 
 
 const char word_delimeters[] = " \t;|&<>()"; 
-int g_unclosed_quote = 0;
+
+#define LEX_UNCLOSED 1
+#define LEX_TRAILING_BACKSLASH 2
+
+// here-document, тело которого ещё не прочитано (начнётся со следующей строки)
+typedef struct {
+    size_t token_idx;
+    char *delim;
+    int strip_tabs; // <<-
+} PendingHeredoc;
 
 int is_delimiter(char c){
     for(int i = 0; i < COUNT_DELIMITERS; ++i){
@@ -23,6 +33,23 @@ int is_space(char c){
 }
 
 
+// перевод строки завершает команду, как ';', - кроме начала ввода и мест,
+// где команда еще не началась или продолжается: после ; & && || | |& ( и {
+static int newline_ends_command(const Token *t, size_t cnt){
+    if (cnt == 0) return 0;
+    switch (t[cnt - 1].type) {
+        case TOKEN_SEMICOL: case TOKEN_AMPER: case TOKEN_AND: case TOKEN_OR:
+        case TOKEN_PIPE: case TOKEN_PIPE_AMPER: case TOKEN_LPAREN:
+            return 0;
+        case TOKEN_WORD:
+            // "{" - открывающая скобка группы, только если стоит на месте команды
+            if (strcmp(t[cnt - 1].value, "{") != 0) return 1;
+            return cnt > 1 && newline_ends_command(t, cnt - 1);
+        default:
+            return 1;
+    }
+}
+
 int define_simple_word(char c){
     if(c == '"' || c == '\'') return WORD_IN_QUOTES;
     if(is_delimiter(c)) return DELIMETERS;
@@ -62,6 +89,14 @@ void print(Token *array_token) {
 
 
 
+// внутри '' обратный слэш обычный символ, внутри "" экранирует только " \ $ `
+static int quote_escapes(char q, const char *input, size_t j){
+    if (input[j] != '\\' || q == '\'') return 0;
+    char next = input[j + 1];
+    return next == '\0' || next == '"' || next == '\\' || next == '$' || next == '`';
+}
+
+
 Token create_token(TokenType type, char *value){
     Token token;
     token.type = type;
@@ -75,6 +110,244 @@ Token create_token(TokenType type, char *value){
 
 
 
+// разделитель после << : слово, кавычки в нём отключают раскрытие тела
+static char *read_heredoc_delim(const char *input, size_t *pos, int *quoted){
+    size_t i = *pos;
+    while (input[i] == ' ' || input[i] == '\t') i++;
+
+    size_t cap = 16, n = 0;
+    char *delim = malloc(cap);
+    if (!delim) return NULL;
+
+    char q = 0;
+    *quoted = 0;
+    while (input[i] != '\0') {
+        char c = input[i];
+        if (!q && (is_space(c) || is_delimiter(c))) break;
+
+        if (!q && (c == '\'' || c == '"')) {
+            q = c;
+            *quoted = 1;
+            i++;
+            continue;
+        }
+        if (q && c == q) {
+            q = 0;
+            i++;
+            continue;
+        }
+        if (c == '\\' && q != '\'' && input[i + 1] != '\0') {
+            *quoted = 1;
+            c = input[++i];
+        }
+
+        if (n + 1 >= cap) {
+            cap *= 2;
+            char *tmp = realloc(delim, cap);
+            if (!tmp) {
+                free(delim);
+                return NULL;
+            }
+            delim = tmp;
+        }
+        delim[n++] = c;
+        i++;
+    }
+    delim[n] = '\0';
+
+    if (q || n == 0) {
+        free(delim);
+        return NULL;
+    }
+    *pos = i;
+    return delim;
+}
+
+// читаем тело here-document с позиции *pos до строки-разделителя.
+// 1 - разделитель не встретился (нужно продолжить ввод), -1 - ошибка памяти
+static int read_heredoc_body(const char *input, size_t *pos, PendingHeredoc *h, char **body_out){
+    size_t p = *pos;
+    size_t dlen = strlen(h->delim);
+
+    size_t cap = 256, n = 0;
+    char *body = malloc(cap);
+    if (!body) return -1;
+
+    while (input[p] != '\0') {
+        const char *eol = strchr(input + p, '\n');
+        size_t line_end = eol ? (size_t)(eol - input) : strlen(input);
+
+        size_t start = p;
+        if (h->strip_tabs) {
+            while (start < line_end && input[start] == '\t') start++;
+        }
+
+        if (line_end - start == dlen && strncmp(input + start, h->delim, dlen) == 0) {
+            body[n] = '\0';
+            *body_out = body;
+            *pos = eol ? line_end + 1 : line_end;
+            return 0;
+        }
+
+        // разделитель без перевода строки мог быть введен не до конца
+        if (!eol) break;
+
+        size_t add = line_end - start + 1;
+        if (n + add + 1 > cap) {
+            while (n + add + 1 > cap) cap *= 2;
+            char *tmp = realloc(body, cap);
+            if (!tmp) {
+                free(body);
+                return -1;
+            }
+            body = tmp;
+        }
+        memcpy(body + n, input + start, add);
+        n += add;
+        p = line_end + 1;
+    }
+
+    free(body);
+    return 1;
+}
+
+// длина подстановки $(...), $((...)) или `...`, начинающейся в j; 0 - не закрыта
+size_t subst_len(const char *input, size_t j){
+    size_t k = j + 1;
+
+    if (input[j] == '`') {
+        while (input[k] && input[k] != '`') {
+            if (input[k] == '\\' && input[k + 1]) k++;
+            k++;
+        }
+        return input[k] ? k + 1 - j : 0;
+    }
+
+    // input[k] == '(' - считаем глубину скобок, пропуская кавычки и вложенные подстановки
+    int depth = 0;
+    while (input[k]) {
+        char c = input[k];
+
+        if (c == '\\' && input[k + 1]) {
+            k += 2;
+            continue;
+        }
+        if (c == '\'') {
+            const char *close = strchr(input + k + 1, '\'');
+            if (!close) return 0;
+            k = (size_t)(close - input) + 1;
+            continue;
+        }
+        if (c == '"') {
+            k++;
+            while (input[k] && input[k] != '"') {
+                if (input[k] == '\\' && input[k + 1]) {
+                    k += 2;
+                } else if ((input[k] == '$' && input[k + 1] == '(') || input[k] == '`') {
+                    size_t n = subst_len(input, k);
+                    if (n == 0) return 0;
+                    k += n;
+                } else {
+                    k++;
+                }
+            }
+            if (!input[k]) return 0;
+            k++;
+            continue;
+        }
+        if (c == '`') {
+            size_t n = subst_len(input, k);
+            if (n == 0) return 0;
+            k += n;
+            continue;
+        }
+
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+            if (depth == 0) return k + 1 - j;
+        }
+        k++;
+    }
+    return 0;
+}
+
+// Одно слово начиная с j: q - открывающая кавычка или 0 для простого слова.
+// out == NULL - первый проход, только длина; иначе копируем.
+// Буквальные $ и ` (из '' или после \) помечаем LEX_ESC, подстановки копируем как есть
+static int lex_word(const char *input, size_t j, char q, char *out, size_t *out_len, size_t *end, int *has_subst){
+    size_t n = 0;
+    *has_subst = 0;
+
+    if (q) j++;
+
+    while (1) {
+        char c = input[j];
+
+        if (c == '\0') {
+            if (q) return LEX_UNCLOSED;
+            break;
+        }
+        if (q && c == q) { // закрывающаящся кавычка
+            j++;
+            break;
+        }
+        if (!q && (is_space(c) || is_delimiter(c))) break;
+
+        if (q == '\'') {
+            if (c == '$' || c == '`') {
+                if (out) out[n] = LEX_ESC;
+                n++;
+            }
+            if (out) out[n] = c;
+            n++;
+            j++;
+            continue;
+        }
+
+        // подстановки разбирает раскрытие слов, здесь только находим их конец
+        if ((c == '$' && input[j + 1] == '(') || c == '`') {
+            size_t sl = subst_len(input, j);
+            if (sl == 0) return LEX_UNCLOSED;
+            if (out) memcpy(out + n, input + j, sl);
+            n += sl;
+            j += sl;
+            *has_subst = 1;
+            continue;
+        }
+        if (c == '$') *has_subst = 1;
+
+        if (c == '\\' && (!q || quote_escapes(q, input, j))) {
+            char e = input[j + 1];
+            if (e == '\0') return q ? LEX_UNCLOSED : LEX_TRAILING_BACKSLASH;
+
+            // берём следующий символ “как есть”
+            if (e == '$' || e == '`') {
+                if (out) out[n] = LEX_ESC;
+                n++;
+            }
+            if (out) out[n] = e;
+            n++;
+            j += 2;
+            continue;
+        }
+
+        if (out) out[n] = c;
+        n++;
+        j++;
+    }
+
+    *out_len = n;
+    *end = j;
+    return 0;
+}
+
+static void free_pending(PendingHeredoc *pending, size_t n){
+    for (size_t k = 0; k < n; ++k) free(pending[k].delim);
+}
+
+
 Token *tokenize(const char *input){
 
     if(!input) { 
@@ -92,17 +365,64 @@ Token *tokenize(const char *input){
         return NULL;
     }
 
-    g_unclosed_quote = 0;
+    g_sh->unclosed_quote = 0;
+    g_sh->unclosed_heredoc = 0;
+
+    PendingHeredoc pending[16];
+    size_t n_pending = 0;
 
     size_t i = 0;
     while (i < len){
-        while(is_space(input[i])) ++i;
+        while(is_space(input[i])) {
+            if (input[i] == '\n' && newline_ends_command(array_token, token_cnt)) {
+                if(token_cnt + 1 >= capacity){
+                    capacity *= 2;
+                    Token *new_array = (Token*)realloc(array_token, capacity * sizeof(Token));
+                    if(!new_array){
+                        perror("realloc error");
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
+                    }
+                    array_token = new_array;
+                }
+                array_token[token_cnt++] = create_token(TOKEN_SEMICOL, ";");
+            }
+            // после перевода строки идут тела here-document
+            if (input[i] == '\n' && n_pending > 0) {
+                i++;
+                for (size_t k = 0; k < n_pending; ++k) {
+                    char *body = NULL;
+                    int rc = read_heredoc_body(input, &i, &pending[k], &body);
+                    if (rc != 0) {
+                        if (rc > 0) g_sh->unclosed_heredoc = 1;
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
+                    }
+                    free(array_token[pending[k].token_idx].value);
+                    array_token[pending[k].token_idx].value = body;
+                }
+                free_pending(pending, n_pending);
+                n_pending = 0;
+                continue;
+            }
+            ++i;
+        }
 
-        if(input[i] == '#') break;
+        // комментарий до конца строки
+        if(input[i] == '#') {
+            while (i < len && input[i] != '\n') ++i;
+            continue;
+        }
 
         if(i >= len) break;
 
-        if(token_cnt >= capacity){ 
+        if(token_cnt + 1 >= capacity){ // всегда оставляем место под EOF
             capacity *= 2;
             Token *new_array = (Token*)realloc(array_token, capacity * sizeof(Token));
             if(!new_array){
@@ -123,6 +443,62 @@ Token *tokenize(const char *input){
                     new_token = create_token(TOKEN_AMPER_REDIR_APPEND, "&>>");
                     i += 3;
 
+                } else if ((input[i] == '<' || input[i] == '>') && input[i+1] == '(') {
+                    // подстановка процесса <(cmd) / >(cmd): слово с меткой, команду копируем как есть
+                    size_t n = subst_len(input, i);
+                    if (n == 0) {
+                        g_sh->unclosed_quote = 1;
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
+                    }
+
+                    char *word = malloc(n + 2);
+                    if (!word) {
+                        perror("malloc error");
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
+                    }
+                    word[0] = LEX_PROCSUBST;
+                    memcpy(word + 1, input + i, n);
+                    word[n + 1] = '\0';
+
+                    new_token = create_token(TOKEN_WORD, word);
+                    free(word);
+                    i += n;
+
+                } else if (input[i] == '<' && input[i+1] == '<' && input[i+2] == '<') {
+                    new_token = create_token(TOKEN_HERESTRING, "<<<");
+                    i += 3;
+                } else if (input[i] == '<' && input[i+1] == '<') {
+                    // << и <<- : разделитель читаем сразу, тело - после конца строки
+                    int strip = input[i+2] == '-';
+                    i += strip ? 3 : 2;
+
+                    int quoted = 0;
+                    char *delim = read_heredoc_delim(input, &i, &quoted);
+                    if (!delim || n_pending >= sizeof(pending) / sizeof(pending[0])) {
+                        fprintf(stderr, "Syntax error: bad here-document\n");
+                        free(delim);
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
+                    }
+
+                    // пока тела нет, значение токена - сам разделитель
+                    new_token = create_token(quoted ? TOKEN_HEREDOC_RAW : TOKEN_HEREDOC, delim);
+                    pending[n_pending].token_idx = token_cnt;
+                    pending[n_pending].delim = delim;
+                    pending[n_pending].strip_tabs = strip;
+                    n_pending++;
+
                 } else if (input[i] == '|' && input[i+1] == '&') {
                     new_token = create_token(TOKEN_PIPE_AMPER, "|&");
                     i += 2;
@@ -138,6 +514,15 @@ Token *tokenize(const char *input){
                 } else if (input[i] == '&' && input[i+1] == '>') {
                     new_token = create_token(TOKEN_AMPER_REDIR_IN, "&>");
                     i += 2;
+                } else if (input[i] == '>' && input[i+1] == '&') {
+                    new_token = create_token(TOKEN_REDIR_DUP_OUT, ">&");
+                    i += 2;
+                } else if (input[i] == '<' && input[i+1] == '&') {
+                    new_token = create_token(TOKEN_REDIR_DUP_IN, "<&");
+                    i += 2;
+                } else if (input[i] == '<' && input[i+1] == '>') {
+                    new_token = create_token(TOKEN_REDIR_RDWR, "<>");
+                    i += 2;
 
 
                 } else if (input[i] == '|') {
@@ -155,6 +540,14 @@ Token *tokenize(const char *input){
                 } else if (input[i] == ';') {
                     new_token = create_token(TOKEN_SEMICOL, ";");
                     i += 1;
+                } else if (input[i] == '(' && input[i+1] == '(' &&
+                           subst_len(input, i) && input[i + subst_len(input, i)] == ')') {
+                    // ((выражение)) - арифметическая команда; ((a); b) остается подоболочкой
+                    size_t n = subst_len(input, i);
+                    char *expr = strndup(input + i + 2, n - 3);
+                    new_token = create_token(TOKEN_ARITH, expr ? expr : "");
+                    free(expr);
+                    i += n + 1;
                 } else if (input[i] == '(') {
                     new_token = create_token(TOKEN_LPAREN, "(");
                     i += 1;
@@ -166,131 +559,69 @@ Token *tokenize(const char *input){
                 array_token[token_cnt++] = new_token;
                 break;          
 
-            case WORD_IN_QUOTES: {
-                char q = input[i];
-                size_t j = i + 1;
-
-                size_t word_len = 0;
-                int closed = 0;
-
+            case WORD_IN_QUOTES:
+            case SIMPLE_WORD: {
+                char q = (type == WORD_IN_QUOTES) ? input[i] : 0;
+                size_t word_len = 0, j = 0;
+                int has_subst = 0;
 
                 //Первый проход считаем длину и проверяем на закрытые кавычки
-                while (j < len) { 
-                    if (input[j] == '\\'){
-                        if (j + 1 >= len) {
-                            g_unclosed_quote = 1;
-                            array_token[token_cnt].type = TOKEN_EOF;
-                            array_token[token_cnt].value = NULL;
-                            free_tokens(array_token);
-                            return NULL;
-                        }
-                        j += 2;
-                        word_len += 1; // 
-                        continue;
-                    }
-
-                    // закрывающаящся кавычка
-                    if (input[j] == q) { 
-                        closed = 1;
-                        break;
+                int rc = lex_word(input, i, q, NULL, &word_len, &j, &has_subst);
+                if (rc != 0) {
+                    if (rc == LEX_UNCLOSED) {
+                        g_sh->unclosed_quote = 1;
+                    } else {
+                        fprintf(stderr, "syntax error: trailing \\\n");
                     }
-
-                    j++;
-                    word_len++;
-                }
-
-                if(!closed) { 
-                    g_unclosed_quote = 1;
+                    free_pending(pending, n_pending);
                     array_token[token_cnt].type = TOKEN_EOF;
                     array_token[token_cnt].value = NULL;
                     free_tokens(array_token);
                     return NULL;
                 }
-                                        
-                char *word = (char*)malloc((word_len + 1) * sizeof(char)); // учитываем последний символ, word_len - последняя позиция
-                if(!word){
-                    perror("malloc error");
-                    break;
-                }
 
-                // Второй проход - копирование с обработкой экранирования
-                size_t out = 0;
-                j = i + 1;
-                while (j < len && out < word_len) {
-                    if (input[j] == '\\') {
-                        // берём следующий символ “как есть”
-                        j++;
-                        word[out++] = input[j];
-                        j++;
-                        continue;
-                    }
-                    if (input[j] == q) break;
-                    word[out++] = input[j++];
-                }
-                word[out] = '\0';
-
-                new_token = create_token(TOKEN_WORD_IN_QUOTES, word);
-                array_token[token_cnt++] = new_token;
-                free(word);
-            
-                i = j + 1;
-                if (i < len && !is_space(input[i]) && !is_delimiter(input[i])) {
+                // слово в "" с подстановками помечаем: результат не делится на поля
+                int mark = (q == '"' && has_subst);
 
-                    fprintf(stderr, "Syntax error: concatenation not supported yet\n");
-                    free_tokens(array_token);
-                    return NULL;
-                }
-            
-                break;
-            }
-            case SIMPLE_WORD: {
-                size_t j = i;
-                size_t word_len = 0;
-
-                // первый проход для длинны слова
-                while (j < len) {
-                    if (is_space(input[j]) || is_delimiter(input[j])) break;
-
-                    if (input[j] == '\\') {
-                        if (j + 1 >= len) {
-                            fprintf(stderr, "syntax error: trailing \\\n");
-                            free_tokens(array_token);
-                            return NULL;
-                        }
-                        j += 2;
-                        word_len += 1;
-                        continue;
-                    }
-
-                    j++;
-                    word_len++;
-                }
-
-                char *word = (char*)malloc((word_len + 1) * sizeof(char));
+                char *word = (char*)malloc((word_len + mark + 1) * sizeof(char));
                 if (!word){
                     perror("malloc error");
+                    free_pending(pending, n_pending);
+                    array_token[token_cnt].type = TOKEN_EOF;
+                    array_token[token_cnt].value = NULL;
                     free_tokens(array_token);
                     return NULL;
                 }
 
-                // Аналогично с словами в кавычках
-                size_t out = 0;
-                j = i;
-                while (j < len && out < word_len) {
-                    if (is_space(input[j]) || is_delimiter(input[j])) break;
-
-                    if (input[j] == '\\') {
-                        j++;
-                        word[out++] = input[j];
-                        j++;
-                        continue;
+                // Второй проход - копирование с обработкой экранирования
+                if (mark) word[0] = LEX_QUOTED;
+                lex_word(input, i, q, word + mark, &word_len, &j, &has_subst);
+                word[word_len + mark] = '\0';
+
+                if (q) {
+                    new_token = create_token(TOKEN_WORD_IN_QUOTES, word);
+                    array_token[token_cnt++] = new_token;
+                    free(word);
+                    i = j;
+
+                    if (i < len && !is_space(input[i]) && !is_delimiter(input[i])) {
+                        fprintf(stderr, "Syntax error: concatenation not supported yet\n");
+                        free_pending(pending, n_pending);
+                        array_token[token_cnt].type = TOKEN_EOF;
+                        array_token[token_cnt].value = NULL;
+                        free_tokens(array_token);
+                        return NULL;
                     }
+                    break;
+                }
 
-                    word[out++] = input[j++];
+                // 2>file: число вплотную к < или > - номер дескриптора
+                int io_number = (j < len && (input[j] == '<' || input[j] == '>') && j - i == word_len);
+                for (size_t k = 0; io_number && k < word_len; ++k) {
+                    if (!isdigit((unsigned char)word[k])) io_number = 0;
                 }
-                word[out] = '\0';
 
-                new_token = create_token(TOKEN_WORD, word);
+                new_token = create_token(io_number ? TOKEN_IO_NUMBER : TOKEN_WORD, word);
                 array_token[token_cnt++] = new_token;
                 free(word);
 
@@ -305,6 +636,16 @@ Token *tokenize(const char *input){
 
 
     }
+    // here-document начат, но тело еще не введено
+    if (n_pending > 0) {
+        g_sh->unclosed_heredoc = 1;
+        free_pending(pending, n_pending);
+        array_token[token_cnt].type = TOKEN_EOF;
+        array_token[token_cnt].value = NULL;
+        free_tokens(array_token);
+        return NULL;
+    }
+
     array_token[token_cnt].type = TOKEN_EOF;
     array_token[token_cnt].value = NULL;
 
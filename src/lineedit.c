@@ -0,0 +1,737 @@
+#define _GNU_SOURCE
+
+#include "../inc/lineedit.h"
+#include "../inc/history.h"
+#include "../inc/complete.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define COMPLETE_LIST_MAX 200  // больше вариантов не выводим списком
+
+// клавиши сверх обычных байтов
+enum {
+    KEY_UP = 256,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_WORD_LEFT,   // Alt-b, Ctrl-Left
+    KEY_WORD_RIGHT,  // Alt-f, Ctrl-Right
+    KEY_KILL_WORD,   // Alt-d
+    KEY_PASTE,       // ESC[200~: начало вставки (bracketed paste)
+    KEY_NONE,        // неизвестная последовательность - пропускаем
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} EditBuf;
+
+typedef struct {
+    EditBuf line;      // редактируемая строка
+    size_t pos;        // курсор, в байтах
+    EditBuf shown;     // что сейчас нарисовано после приглашения
+    size_t shown_pos;  // где курсор на экране, в байтах shown
+    int prompt_w;
+    int cols;
+    EditBuf out;       // всё, что уйдет в терминал за одно нажатие
+    size_t hist_back;  // на сколько записей назад по истории; 0 - новая строка
+    char *saved;       // новая строка, пока листаем историю
+} LineState;
+
+static char *kill_buf = NULL;
+static char *pending = NULL;  // хвост вставки после последнего перевода строки - начало следующей строки
+
+// прочитанные, но еще не разобранные байты (вставка приходит одним read)
+static unsigned char in_buf[4096];
+static size_t in_len = 0;
+static size_t in_pos = 0;
+
+static int buf_insert(EditBuf *b, size_t at, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 128;
+        while (b->len + n + 1 > cap) cap *= 2;
+        char *p = realloc(b->data, cap);
+        if (!p) return 1;
+        b->data = p;
+        b->cap = cap;
+    }
+    memmove(b->data + at + n, b->data + at, b->len - at);
+    memcpy(b->data + at, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+static void buf_erase(EditBuf *b, size_t at, size_t n) {
+    memmove(b->data + at, b->data + at + n, b->len - at - n);
+    b->len -= n;
+    b->data[b->len] = '\0';
+}
+
+static void buf_set(EditBuf *b, const char *s, size_t n) {
+    b->len = 0;
+    if (buf_insert(b, 0, s, n) != 0 && b->data) b->data[0] = '\0';
+}
+
+static void out_add(LineState *ls, const char *s) {
+    buf_insert(&ls->out, ls->out.len, s, strlen(s));
+}
+
+// ---- UTF-8 и ширина на экране ----
+
+static size_t utf8_next(const char *s, size_t len, size_t i) {
+    if (i < len) i++;
+    while (i < len && ((unsigned char)s[i] & 0xC0) == 0x80) i++;
+    return i;
+}
+
+static size_t utf8_prev(const char *s, size_t i) {
+    while (i > 0) {
+        i--;
+        if (((unsigned char)s[i] & 0xC0) != 0x80) break;
+    }
+    return i;
+}
+
+static unsigned utf8_decode(const unsigned char *s, size_t n) {
+    if (s[0] < 0x80 || n < 2) return s[0];
+    if (s[0] < 0xE0) return (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+    if (s[0] < 0xF0 || n < 4) return n < 3 ? 0xFFFD : (unsigned)(s[0] & 0x0F) << 12 | (s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+    return (unsigned)(s[0] & 0x07) << 18 | (s[1] & 0x3F) << 12 | (s[2] & 0x3F) << 6 | (s[3] & 0x3F);
+}
+
+// ширина символа без wcwidth: не зависим от локали шелла
+static int char_width(unsigned cp) {
+    if ((cp >= 0x0300 && cp <= 0x036F) || cp == 0x200B || (cp >= 0xFE00 && cp <= 0xFE0F)) return 0;
+    if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF) ||
+        (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) ||
+        (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60) ||
+        (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1F64F) ||
+        (cp >= 0x1F900 && cp <= 0x1F9FF) || (cp >= 0x20000 && cp <= 0x3FFFD)) return 2;
+    return 1;
+}
+
+static int text_width(const char *s, size_t n) {
+    int w = 0;
+    for (size_t i = 0; i < n;) {
+        size_t next = utf8_next(s, n, i);
+        w += char_width(utf8_decode((const unsigned char *)s + i, next - i));
+        i = next;
+    }
+    return w;
+}
+
+// ширина приглашения без цветовых последовательностей \033[...m
+static int prompt_width(const char *p) {
+    size_t n = strlen(p), plain = 0;
+    char *tmp = malloc(n + 1);
+    if (!tmp) return 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (p[i] == '\033' && i + 1 < n && p[i + 1] == '[') {
+            i += 2;
+            while (i < n && ((unsigned char)p[i] < 0x40 || (unsigned char)p[i] > 0x7E)) i++;
+            continue;
+        }
+        tmp[plain++] = p[i];
+    }
+    int w = text_width(tmp, plain);
+    free(tmp);
+    return w;
+}
+
+static int term_cols(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0) return 80;
+    return ws.ws_col;
+}
+
+// ---- перерисовка ----
+
+// курсор из колонки from в колонку to (считая от начала приглашения, с переносами)
+static void move_cursor(LineState *ls, int from, int to) {
+    char seq[32];
+    int r1 = from / ls->cols, c1 = from % ls->cols;
+    int r2 = to / ls->cols, c2 = to % ls->cols;
+
+    if (r2 < r1) {
+        snprintf(seq, sizeof(seq), "\033[%dA", r1 - r2);
+        out_add(ls, seq);
+    } else if (r2 > r1) {
+        snprintf(seq, sizeof(seq), "\033[%dB", r2 - r1);
+        out_add(ls, seq);
+    }
+
+    if (c2 == c1) return;
+    if (c2 == 0) {
+        out_add(ls, "\r");
+    } else {
+        snprintf(seq, sizeof(seq), c2 > c1 ? "\033[%dC" : "\033[%dD", c2 > c1 ? c2 - c1 : c1 - c2);
+        out_add(ls, seq);
+    }
+}
+
+static void flush_out(LineState *ls) {
+    size_t off = 0;
+    while (off < ls->out.len) {
+        ssize_t n = write(STDOUT_FILENO, ls->out.data + off, ls->out.len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    ls->out.len = 0;
+}
+
+// Рисуем только то, что отличается от экрана: общий префикс с нарисованной строкой
+// не трогаем, хвост переписываем, остаток старого стираем. Всё - одним write.
+// текст строки на экран. '\n' бывает в строке из истории (многострочная команда):
+// рисуем его знаком в одну колонку, иначе терминал уведет курсор на новую строку
+static void out_text(LineState *ls, const char *s, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const char *nl = memchr(s + i, '\n', n - i);
+        size_t end = nl ? (size_t)(nl - s) : n;
+        buf_insert(&ls->out, ls->out.len, s + i, end - i);
+        if (!nl) break;
+        out_add(ls, "\u21B5");
+        i = end;
+    }
+}
+
+static void refresh(LineState *ls) {
+    EditBuf *b = &ls->line, *s = &ls->shown;
+    size_t p = 0;
+    while (p < b->len && p < s->len && b->data[p] == s->data[p]) p++;
+    while (p > 0 && p < b->len && ((unsigned char)b->data[p] & 0xC0) == 0x80) p--;
+
+    int w = ls->prompt_w;
+    int cur = w + text_width(s->data, ls->shown_pos);
+
+    if (p < b->len || p < s->len) {
+        int at = w + text_width(b->data, p);
+        int end_old = w + text_width(s->data, s->len);
+        move_cursor(ls, cur, at);
+        out_text(ls, b->data + p, b->len - p);
+        cur = at + text_width(b->data + p, b->len - p);
+        // курсор за последней колонкой висит на той же строке - переносим явно
+        if (b->len > p && cur % ls->cols == 0) out_add(ls, "\r\n");
+        if (end_old > cur) out_add(ls, "\033[J");
+    }
+    move_cursor(ls, cur, w + text_width(b->data, ls->pos));
+    flush_out(ls);
+
+    buf_set(s, b->data ? b->data : "", b->len);
+    ls->shown_pos = ls->pos;
+}
+
+// ---- ввод ----
+
+static int read_byte(void) {
+    if (in_pos == in_len) {
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, in_buf, sizeof(in_buf))) < 0 && errno == EINTR);
+        if (n <= 0) return -1;
+        in_len = n;
+        in_pos = 0;
+    }
+    return in_buf[in_pos++];
+}
+
+static int read_key(void) {
+    int c = read_byte();
+    if (c != 27) return c;
+
+    int c1 = read_byte();
+    if (c1 < 0) return -1;
+    if (c1 == '[' || c1 == 'O') {
+        char params[16];
+        int n = 0, f;
+        while ((f = read_byte()) >= 0 && (f < 0x40 || f > 0x7E)) {
+            if (n < (int)sizeof(params) - 1) params[n++] = f;
+        }
+        if (f < 0) return -1;
+        params[n] = '\0';
+        int mod = strstr(params, ";5") != NULL;  // с Ctrl
+
+        switch (f) {
+            case 'A': return KEY_UP;
+            case 'B': return KEY_DOWN;
+            case 'C': return mod ? KEY_WORD_RIGHT : KEY_RIGHT;
+            case 'D': return mod ? KEY_WORD_LEFT : KEY_LEFT;
+            case 'H': return KEY_HOME;
+            case 'F': return KEY_END;
+            case '~':
+                switch (atoi(params)) {
+                    case 1: case 7: return KEY_HOME;
+                    case 4: case 8: return KEY_END;
+                    case 3: return KEY_DELETE;
+                    case 200: return KEY_PASTE;
+                }
+                break;
+        }
+        return KEY_NONE;
+    }
+
+    // Alt-клавиша приходит как ESC и сама клавиша
+    switch (c1) {
+        case 'b': return KEY_WORD_LEFT;
+        case 'f': return KEY_WORD_RIGHT;
+        case 'd': return KEY_KILL_WORD;
+        case 127: return KEY_CTRL('W');
+    }
+    return KEY_NONE;
+}
+
+// Текст вставки до ESC[201~ как есть, без разбора клавиш. Терминал присылает
+// переводы строк как '\r' - приводим к '\n'.
+static void read_paste(EditBuf *b) {
+    static const char end[] = "\033[201~";
+    size_t matched = 0;
+    int c, prev = 0;
+    while ((c = read_byte()) >= 0) {
+        if (c == end[matched]) {
+            if (++matched == sizeof(end) - 1) break;
+            continue;
+        }
+        if (matched > 0) {
+            buf_insert(b, b->len, end, matched);
+            matched = c == end[0];
+            if (matched) continue;
+        }
+        if (c == '\n' && prev == '\r') {
+            prev = c;
+            continue;
+        }
+        prev = c;
+        char ch = c == '\r' ? '\n' : c;
+        buf_insert(b, b->len, &ch, 1);
+    }
+}
+
+// ---- правка ----
+
+static int is_word(char c) {
+    return isalnum((unsigned char)c) || (unsigned char)c >= 0x80 || c == '_';
+}
+
+static size_t word_left(LineState *ls) {
+    size_t i = ls->pos;
+    while (i > 0 && !is_word(ls->line.data[i - 1])) i--;
+    while (i > 0 && is_word(ls->line.data[i - 1])) i--;
+    return i;
+}
+
+static size_t word_right(LineState *ls) {
+    size_t i = ls->pos;
+    while (i < ls->line.len && !is_word(ls->line.data[i])) i++;
+    while (i < ls->line.len && is_word(ls->line.data[i])) i++;
+    return i;
+}
+
+// вырезаем [from, to) в kill_buf - Ctrl-Y вставит обратно
+static void kill_range(LineState *ls, size_t from, size_t to) {
+    if (from >= to) return;
+    char *k = strndup(ls->line.data + from, to - from);
+    if (k) {
+        free(kill_buf);
+        kill_buf = k;
+    }
+    buf_erase(&ls->line, from, to - from);
+    ls->pos = from;
+}
+
+static void history_move(LineState *ls, int dir) {
+    size_t n = history_count();
+    if (dir < 0 ? ls->hist_back >= n : ls->hist_back == 0) return;
+
+    if (ls->hist_back == 0) {
+        free(ls->saved);
+        ls->saved = strndup(ls->line.data ? ls->line.data : "", ls->line.len);
+    }
+    ls->hist_back -= dir;
+
+    size_t len;
+    const char *s = ls->hist_back ? history_entry(n - ls->hist_back, &len) : NULL;
+    if (!s) {
+        s = ls->saved ? ls->saved : "";
+        len = strlen(s);
+    }
+    buf_set(&ls->line, s, len);
+    ls->pos = ls->line.len;
+}
+
+// приглашение сменилось: стираем всё от его начала и рисуем заново
+static void redraw(LineState *ls, const char *prompt) {
+    move_cursor(ls, ls->prompt_w + text_width(ls->shown.data, ls->shown_pos), 0);
+    out_add(ls, "\033[J");
+    out_add(ls, prompt);
+    ls->prompt_w = prompt_width(prompt);
+    ls->shown.len = 0;
+    ls->shown_pos = 0;
+    refresh(ls);
+}
+
+// Ctrl-R: поиск по истории с набором образца. Возвращает клавишу, которой поиск
+// закончился (ее обрабатывает обычный цикл), или 0, если поиск отменен Ctrl-G.
+static int search_history(LineState *ls, const char *prompt) {
+    EditBuf pat = { NULL, 0, 0 };
+    buf_set(&pat, "", 0);
+    char *orig = strndup(ls->line.data ? ls->line.data : "", ls->line.len);
+    size_t orig_pos = ls->pos;
+    size_t n = history_count();
+    size_t match = HISTORY_NONE;
+    int failed = 0, key;
+
+    for (;;) {
+        // как и при правке, вставленный пачкой образец рисуем один раз
+        if (in_pos == in_len) {
+            char *sp = NULL;
+            if (asprintf(&sp, "(%sreverse-i-search)`%s': ", failed ? "failed " : "", pat.data) < 0) sp = NULL;
+            redraw(ls, sp ? sp : prompt);
+            free(sp);
+        }
+
+        key = read_key();
+        size_t before;
+        if (key == KEY_CTRL('R')) {
+            before = match == HISTORY_NONE ? n : match;
+        } else if (key == 127 || key == KEY_CTRL('H')) {
+            if (pat.len > 0) buf_erase(&pat, utf8_prev(pat.data, pat.len), pat.len - utf8_prev(pat.data, pat.len));
+            before = n;
+        } else if (key >= 32 && key <= 255) {
+            char ch[4] = { (char)key };
+            size_t len = 1, need = key >= 0xF0 ? 4 : key >= 0xE0 ? 3 : key >= 0xC0 ? 2 : 1;
+            while (len < need) {
+                int c = read_byte();
+                if (c < 0 || (c & 0xC0) != 0x80) break;
+                ch[len++] = c;
+            }
+            buf_insert(&pat, pat.len, ch, len);
+            // более длинный образец может подойти и к текущей записи
+            before = match == HISTORY_NONE ? n : match + 1;
+        } else {
+            break;
+        }
+
+        if (pat.len == 0) {
+            failed = 0;
+            continue;
+        }
+        size_t found = history_search(pat.data, before);
+        failed = found == HISTORY_NONE;
+        if (failed) continue;
+
+        match = found;
+        size_t len;
+        const char *s = history_entry(match, &len);
+        buf_set(&ls->line, s, len);
+        const char *at = memmem(ls->line.data, ls->line.len, pat.data, pat.len);
+        ls->pos = at ? (size_t)(at - ls->line.data) : 0;
+    }
+
+    if (key == KEY_CTRL('G')) {
+        buf_set(&ls->line, orig, strlen(orig));
+        ls->pos = orig_pos;
+        key = 0;
+    } else if (match != HISTORY_NONE) {
+        // дальше Up/Down идут от найденной записи
+        if (ls->hist_back == 0) {
+            free(ls->saved);
+            ls->saved = orig;
+            orig = NULL;
+        }
+        ls->hist_back = n - match;
+    }
+    free(orig);
+    free(pat.data);
+    redraw(ls, prompt);
+    return key;
+}
+
+// список вариантов под строкой, затем приглашение и строка заново
+static void list_candidates(LineState *ls, const char *prompt, Completion *c) {
+    int w = ls->prompt_w;
+    move_cursor(ls, w + text_width(ls->shown.data, ls->shown_pos), w + text_width(ls->shown.data, ls->shown.len));
+    out_add(ls, "\r\n");
+
+    size_t shown = c->n < COMPLETE_LIST_MAX ? c->n : COMPLETE_LIST_MAX;
+    int width = 0;
+    for (size_t i = 0; i < shown; ++i) {
+        int iw = text_width(c->items[i], strlen(c->items[i]));
+        if (iw > width) width = iw;
+    }
+    width += 2;
+    int per_row = ls->cols / width > 0 ? ls->cols / width : 1;
+
+    for (size_t i = 0; i < shown; ++i) {
+        out_add(ls, c->items[i]);
+        if ((i + 1) % per_row == 0 || i + 1 == shown) {
+            out_add(ls, "\r\n");
+        } else {
+            for (int pad = width - text_width(c->items[i], strlen(c->items[i])); pad > 0; --pad) out_add(ls, " ");
+        }
+    }
+    if (shown < c->n) {
+        char more[64];
+        snprintf(more, sizeof(more), "... %zu more\r\n", c->n - shown);
+        out_add(ls, more);
+    }
+
+    out_add(ls, prompt);
+    ls->shown.len = 0;
+    ls->shown_pos = 0;
+}
+
+// Tab: слово заменяется общим началом вариантов; если дописать нечего,
+// второй Tab подряд показывает список
+static void complete_word(LineState *ls, const char *prompt, int again) {
+    Completion c;
+    if (complete(ls->line.data, ls->pos, &c) != 0 || c.n == 0) {
+        out_add(ls, "\a");
+        completion_free(&c);
+        return;
+    }
+
+    size_t common = strlen(c.items[0]);
+    for (size_t i = 1; i < c.n; ++i) {
+        size_t k = 0;
+        while (k < common && c.items[i][k] == c.items[0][k]) k++;
+        common = k;
+    }
+    while (common > 0 && ((unsigned char)c.items[0][common] & 0xC0) == 0x80) common--;
+    // не обрываем слово на экранирующей косой черте
+    if (common > 0 && c.items[0][common - 1] == '\\' && common < strlen(c.items[0])) common--;
+
+    size_t wlen = ls->pos - c.start;
+    if (common != wlen || memcmp(ls->line.data + c.start, c.items[0], common) != 0) {
+        buf_erase(&ls->line, c.start, wlen);
+        buf_insert(&ls->line, c.start, c.items[0], common);
+        ls->pos = c.start + common;
+    } else if (again) {
+        list_candidates(ls, prompt, &c);
+    } else {
+        out_add(ls, "\a");
+    }
+    completion_free(&c);
+}
+
+// терминал не в raw-режиме (не tty, ошибка termios): приглашение и обычный getline
+static int read_cooked(const char *prompt, char **out) {
+    fputs(prompt, stdout);
+    fflush(stdout);
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, stdin);
+    if (n < 0) {
+        free(line);
+        return LINEEDIT_EOF;
+    }
+    if (n > 0 && line[n - 1] == '\n') line[n - 1] = '\0';
+    *out = line;
+    return LINEEDIT_OK;
+}
+
+int lineedit_read(const char *prompt, char **out) {
+    *out = NULL;
+    fflush(stdout);
+
+    struct termios orig, raw;
+    if (tcgetattr(STDIN_FILENO, &orig) < 0) return read_cooked(prompt, out);
+    raw = orig;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) < 0) return read_cooked(prompt, out);
+
+    LineState ls = { .prompt_w = prompt_width(prompt), .cols = term_cols(), .hist_back = 0 };
+    buf_set(&ls.line, pending ? pending : "", pending ? strlen(pending) : 0);
+    ls.pos = ls.line.len;
+    free(pending);
+    pending = NULL;
+    // включаем bracketed paste: вставка придет между ESC[200~ и ESC[201~
+    out_add(&ls, "\033[?2004h");
+    out_add(&ls, prompt);
+    refresh(&ls);
+
+    int rc = LINEEDIT_OK;
+    for (int done = 0, prev = 0; !done;) {
+        int key = read_key();
+        if (key == KEY_CTRL('R')) {
+            key = search_history(&ls, prompt);
+            if (key == 0) continue;
+        }
+        EditBuf *b = &ls.line;
+
+        switch (key) {
+            case -1:
+                rc = LINEEDIT_EOF;
+                done = 1;
+                break;
+            case '\r':
+            case '\n':
+                done = 1;
+                break;
+            case KEY_CTRL('C'):
+                rc = LINEEDIT_INTR;
+                done = 1;
+                break;
+            case KEY_CTRL('D'):
+                if (b->len == 0) {
+                    rc = LINEEDIT_EOF;
+                    done = 1;
+                    break;
+                }
+                // fall through
+            case KEY_DELETE:
+                if (ls.pos < b->len) buf_erase(b, ls.pos, utf8_next(b->data, b->len, ls.pos) - ls.pos);
+                break;
+            case 127:
+            case KEY_CTRL('H'):
+                if (ls.pos > 0) {
+                    size_t prev = utf8_prev(b->data, ls.pos);
+                    buf_erase(b, prev, ls.pos - prev);
+                    ls.pos = prev;
+                }
+                break;
+            case KEY_CTRL('A'):
+            case KEY_HOME:
+                ls.pos = 0;
+                break;
+            case KEY_CTRL('E'):
+            case KEY_END:
+                ls.pos = b->len;
+                break;
+            case KEY_CTRL('B'):
+            case KEY_LEFT:
+                ls.pos = utf8_prev(b->data, ls.pos);
+                break;
+            case KEY_CTRL('F'):
+            case KEY_RIGHT:
+                ls.pos = utf8_next(b->data, b->len, ls.pos);
+                break;
+            case KEY_WORD_LEFT:
+                ls.pos = word_left(&ls);
+                break;
+            case KEY_WORD_RIGHT:
+                ls.pos = word_right(&ls);
+                break;
+            case KEY_CTRL('K'):
+                kill_range(&ls, ls.pos, b->len);
+                break;
+            case KEY_CTRL('U'):
+                kill_range(&ls, 0, ls.pos);
+                break;
+            case KEY_CTRL('W'): {
+                // как unix-word-rubout: до пробела слева
+                size_t i = ls.pos;
+                while (i > 0 && isspace((unsigned char)b->data[i - 1])) i--;
+                while (i > 0 && !isspace((unsigned char)b->data[i - 1])) i--;
+                kill_range(&ls, i, ls.pos);
+                break;
+            }
+            case KEY_KILL_WORD:
+                kill_range(&ls, ls.pos, word_right(&ls));
+                break;
+            case KEY_CTRL('Y'):
+                if (kill_buf && buf_insert(b, ls.pos, kill_buf, strlen(kill_buf)) == 0) ls.pos += strlen(kill_buf);
+                break;
+            case KEY_CTRL('P'):
+            case KEY_UP:
+                history_move(&ls, -1);
+                break;
+            case KEY_CTRL('N'):
+            case KEY_DOWN:
+                history_move(&ls, 1);
+                break;
+            case '\t':
+                complete_word(&ls, prompt, prev == '\t');
+                break;
+            case KEY_PASTE: {
+                EditBuf paste = { NULL, 0, 0 };
+                buf_set(&paste, "", 0);
+                read_paste(&paste);
+                if (buf_insert(b, ls.pos, paste.data, paste.len) == 0) ls.pos += paste.len;
+                free(paste.data);
+
+                // Вставка из нескольких строк отдается целиком, без построчного чтения:
+                // полные строки выполняются сразу, неполная последняя ждет в следующей строке
+                char *nl = memrchr(b->data, '\n', b->len);
+                if (nl) {
+                    pending = nl[1] ? strdup(nl + 1) : NULL;
+                    b->len = nl - b->data;
+                    b->data[b->len] = '\0';
+                    rc = LINEEDIT_PASTE;
+                    done = 1;
+                }
+                break;
+            }
+            case KEY_CTRL('L'):
+                // экран заново: приглашение и вся строка
+                ls.cols = term_cols();
+                out_add(&ls, "\033[H\033[2J");
+                out_add(&ls, prompt);
+                ls.shown.len = 0;
+                ls.shown_pos = 0;
+                break;
+            default:
+                if (key < 32 || key > 255) break;
+                // символ UTF-8 вставляется целиком, чтобы не рисовать его половину
+                char ch[4] = { (char)key };
+                size_t n = 1;
+                size_t need = key >= 0xF0 ? 4 : key >= 0xE0 ? 3 : key >= 0xC0 ? 2 : 1;
+                while (n < need) {
+                    int c = read_byte();
+                    if (c < 0 || (c & 0xC0) != 0x80) break;
+                    ch[n++] = c;
+                }
+                if (buf_insert(b, ls.pos, ch, n) == 0) ls.pos += n;
+                break;
+        }
+
+        prev = key;
+
+        if (done && rc == LINEEDIT_PASTE) {
+            // текст вставки выводим один раз поверх строки, '\n' переведет сам терминал (OPOST)
+            move_cursor(&ls, ls.prompt_w + text_width(ls.shown.data, ls.shown_pos), ls.prompt_w);
+            out_add(&ls, "\033[J");
+            out_add(&ls, b->data);
+            out_add(&ls, "\r\n\033[?2004l");
+            flush_out(&ls);
+        } else if (done) {
+            ls.pos = b->len;
+            refresh(&ls);
+            out_add(&ls, rc == LINEEDIT_INTR ? "^C\r\n" : rc == LINEEDIT_OK ? "\r\n" : "");
+            out_add(&ls, "\033[?2004l");
+            flush_out(&ls);
+        } else if (in_pos == in_len) {
+            // вставка приходит одним read: перерисовываем после всей пачки
+            refresh(&ls);
+        }
+    }
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+
+    if (rc == LINEEDIT_OK || rc == LINEEDIT_PASTE) {
+        *out = ls.line.data;
+        ls.line.data = NULL;
+    }
+    free(ls.line.data);
+    free(ls.shown.data);
+    free(ls.out.data);
+    free(ls.saved);
+    return rc;
+}
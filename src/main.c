@@ -1,11 +1,17 @@
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include "../inc/lexer.h"
 #include "../inc/ast.h"
 #include "../inc/parser.h" 
 #include "../inc/execution.h" 
 #include "../inc/jobs.h" 
+#include "../inc/outbuf.h"
+#include "../inc/optimize.h"
+#include "../inc/mybash.h"
+#include "../inc/server.h"
+#include "../inc/lineedit.h"
+#include "../inc/history.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -14,19 +20,35 @@
 #include <sys/wait.h>
 #include <signal.h>
 
-extern int g_unclosed_quote;
 
-void print_prompt(){ 
+static void make_prompt(char *buf, size_t size){ 
     char hostname[HOST_NAME_MAX];
     char cwd[PATH_MAX];
     char *username = getenv("USER");
 
     gethostname(hostname, HOST_NAME_MAX);
-    getcwd(cwd, PATH_MAX);
+    if (!getcwd(cwd, PATH_MAX)) strcpy(cwd, "?");
 
-    printf("\033[1;35m%s@%s\033[0m:\033[1;34m%s\033[0m$ ", username ? username : "user", hostname, cwd);
-    fflush(stdout);
+    snprintf(buf, size, "\033[1;35m%s@%s\033[0m:\033[1;34m%s\033[0m$ ", username ? username : "user", hostname, cwd);
+}
+
+// одна физическая строка: на терминале - через редактор, иначе getline.
+// -1 - конец ввода, -2 - Ctrl-C в редакторе; *pasted - пришла вставка из нескольких строк
+static ssize_t read_line(const char *prompt, int editor, char **line, size_t *cap, int *pasted) {
+    if (editor) {
+        char *edited = NULL;
+        int rc = lineedit_read(prompt, &edited);
+        if (rc == LINEEDIT_PASTE) *pasted = 1;
+        else if (rc != LINEEDIT_OK) return rc == LINEEDIT_INTR ? -2 : -1;
+        free(*line);
+        *line = edited;
+        *cap = strlen(edited) + 1;
+        return strlen(edited);
+    }
 
+    printf("%s", prompt);
+    fflush(stdout);
+    return getline(line, cap, stdin);
 }
 
 
@@ -49,7 +71,7 @@ void test_parser(const char *input) {
 
     free_tokens(tokens);
 }
-static char *read_command_line(void) {
+static char *read_command_line(MyBash *sh, const char *prompt, int editor, int *pasted) {
     char *curr_line = NULL;
     size_t line_buf_size = 0;
 
@@ -58,13 +80,13 @@ static char *read_command_line(void) {
     int first_line = 1;
 
     while (1) {
-        // Показываем приглашение
-        if (!first_line) {
-            printf("> ");
-            fflush(stdout);
+        ssize_t n = read_line(first_line ? prompt : "> ", editor, &curr_line, &line_buf_size, pasted);
+        if (n == -2) {
+            // Ctrl-C: бросаем и продолжение многострочной команды
+            free(curr_line);
+            free(accum_input);
+            return strdup("");
         }
-
-        ssize_t n = getline(&curr_line, &line_buf_size, stdin);
         if (n < 0) {
             free(curr_line);
             free(accum_input);
@@ -112,8 +134,8 @@ static char *read_command_line(void) {
         Token *test_tokens = tokenize(accum_input);
                 
         if (!test_tokens) {
-            if (g_unclosed_quote) {
-                // Незакрытые кавычки - продолжаем ввод
+            if (mybash_incomplete(sh)) {
+                // Незакрытые кавычки или here-document - продолжаем ввод
                 first_line = 0;
                 continue;
             } else {
@@ -135,17 +157,68 @@ static char *read_command_line(void) {
 }
 
 
-int main() {
+int main(int argc, char **argv) {
+
+    // помощник set -o zygote: тот же бинарник, запущенный шеллом
+    int zrc = mybash_zygote(argc, argv);
+    if (zrc >= 0) return zrc;
 
-    init_shell();
+    // всё, что досталось от родителя кроме 0-2, не должно уйти в запускаемые программы;
+    // свои дескрипторы шелл и так открывает с O_CLOEXEC. Это дело программы,
+    // а не библиотеки: чужие дескрипторы хозяина libmybash трогать нельзя
+    close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        int max_clients = SERVER_MAX_CLIENTS;
+        if (argc == 5 && strcmp(argv[3], "--max-clients") == 0) {
+            max_clients = atoi(argv[4]);
+        } else if (argc != 3) {
+            max_clients = 0;
+        }
+        if (max_clients <= 0) {
+            fprintf(stderr, "usage: %s --server PATH [--max-clients N]\n", argv[0]);
+            return 2;
+        }
+        MyBash *sh = mybash_new(0);
+        if (!sh) return 1;
+        return server_main(sh, argv[2], max_clients);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+            return 2;
+        }
+        // mybash -c 'команды': без управления заданиями,
+        // последняя простая команда заменяет процесс шелла (exec без fork)
+        MyBash *sh = mybash_new(0);
+        if (!sh) return 1;
+        int rc = mybash_run(sh, argv[2], MYBASH_RUN_TAIL);
+        mybash_free(sh);
+        return rc;
+    }
+
+    MyBash *sh = mybash_new(MYBASH_JOB_CONTROL);
+    if (!sh) return 1;
+
+    // редактор строки - только когда и ввод, и вывод на терминале
+    int editor = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+    // журнал читается всегда (для history), пишется - только из интерактивного шелла
+    int interactive = isatty(STDIN_FILENO);
+    history_open(NULL);
+    char prompt[HOST_NAME_MAX + PATH_MAX + 64];
+    int rc = 0;
 
     while(1){
+        out_flush_all(); // вывод встроенных команд до приглашения
         check_background_jobs();
-        print_prompt();
+        make_prompt(prompt, sizeof(prompt));
 
-        char *cmd = read_command_line();
+        int pasted = 0;
+        char *cmd = read_command_line(sh, prompt, editor, &pasted);
 
         if(!cmd) { 
+            out_flush_all();
             printf("\n");
             break;
         }
@@ -154,21 +227,33 @@ int main() {
             free(cmd);
             continue;
         }
-
         Token *tokens = tokenize(cmd);
-        free(cmd);
-        if (!tokens) continue;
+        if (!tokens) {
+            free(cmd);
+            continue;
+        }
 
         ASTNode *ast = parse(tokens);
+        // в историю - только разобранные команды
+        if (ast && interactive) history_add(cmd);
+        free(cmd);
+
+        ast = optimize_ast(ast);
         if (ast) {
-            print_ast(ast);
-            execute(ast);
+            // вставка выполняется как скрипт: одним разбором, без отладочного дерева
+            if (!pasted) print_ast(ast);
+            mybash_execute(sh, ast);
 
             free_ast(ast);
         }
         
         free_tokens(tokens);
 
+        // exit: шелл закончил работу, код - у exit
+        if (mybash_exited(sh)) {
+            rc = mybash_status(sh);
+            break;
+        }
 
     }
 
@@ -193,5 +278,7 @@ int main() {
     // test_parser("gcc main.c -o main && ./main | grep output > result.txt || echo error");
 
     
-    return 0;
+    history_close();
+    mybash_free(sh);
+    return rc;
 }
\ No newline at end of file
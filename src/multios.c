@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+
+#include "../inc/multios.h"
+#include "../inc/expand.h"
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#define MULTIOS_MAX_HELPERS 16
+#define FANOUT_CHUNK (64 * 1024)
+
+// помощники текущей команды и их концы пайпов в шелле
+static struct {
+    pid_t pid;
+    int wfd;
+} helpers[MULTIOS_MAX_HELPERS];
+static int n_helpers = 0;
+
+static char fanout_buf[FANOUT_CHUNK];
+
+typedef struct {
+    int fd;       // -1 - цель отвалилась (ошибка записи), данные для неё пропускаем
+    int splice;   // 0 - только read/write: O_APPEND или splice вернул EINVAL
+    int pipe[2];  // промежуточный пайп для tee
+} FanTarget;
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// переносим ровно len байт из пайпа from в файл цели
+static int drain(int from, FanTarget *t, size_t len) {
+    while (len > 0) {
+        ssize_t n;
+        if (t->splice) {
+            n = splice(from, NULL, t->fd, NULL, len, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL) { // файл не умеет splice - дальше копированием
+                t->splice = 0;
+                continue;
+            }
+        } else {
+            n = read(from, fanout_buf, len < FANOUT_CHUNK ? len : FANOUT_CHUNK);
+            if (n > 0 && write_all(t->fd, fanout_buf, n) < 0) n = -1;
+        }
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+// Цикл помощника: tee копирует данные входного пайпа в пайп каждой цели, кроме последней,
+// не забирая их; последняя получает их splice'ом прямо из входа. В user space данные
+// попадают только для целей без splice и если tee отдал меньше, чем ожидалось.
+static void fanout(int in, FanTarget *t, int n) {
+    size_t *got = malloc(sizeof(size_t) * n);
+    if (!got) _exit(1);
+
+    for (;;) {
+        ssize_t len = -1;
+        int short_copy = 0;
+
+        for (int k = 0; k < n - 1; ++k) {
+            got[k] = 0;
+            if (t[k].fd < 0) continue;
+
+            ssize_t r;
+            do {
+                r = tee(in, t[k].pipe[1], len < 0 ? FANOUT_CHUNK : (size_t)len, 0);
+            } while (r < 0 && errno == EINTR);
+
+            if (r == 0 && len < 0) goto done; // писатели закрыли пайп
+            if (r < 0) {
+                t[k].fd = -1;
+                continue;
+            }
+            if (len < 0) len = r;
+
+            got[k] = r;
+            if ((size_t)r < (size_t)len) short_copy = 1;
+            if (drain(t[k].pipe[0], &t[k], r) < 0) t[k].fd = -1;
+        }
+
+        FanTarget *last = &t[n - 1];
+
+        // все промежуточные цели отвалились - длину берем по факту чтения
+        if (len < 0) {
+            ssize_t r;
+            do {
+                r = read(in, fanout_buf, FANOUT_CHUNK);
+            } while (r < 0 && errno == EINTR);
+            if (r <= 0) goto done;
+            if (last->fd >= 0 && write_all(last->fd, fanout_buf, r) < 0) last->fd = -1;
+            continue;
+        }
+
+        if (!short_copy && last->fd >= 0) {
+            if (drain(in, last, len) < 0) last->fd = -1;
+            continue;
+        }
+
+        // редкий случай: забираем порцию в буфер и дописываем недостающие хвосты
+        size_t off = 0;
+        while (off < (size_t)len) {
+            ssize_t r = read(in, fanout_buf + off, len - off);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) goto done;
+            off += r;
+        }
+        for (int k = 0; k < n - 1; ++k) {
+            if (t[k].fd >= 0 && got[k] < (size_t)len &&
+                write_all(t[k].fd, fanout_buf + got[k], len - got[k]) < 0) t[k].fd = -1;
+        }
+        if (last->fd >= 0 && write_all(last->fd, fanout_buf, len) < 0) last->fd = -1;
+    }
+
+done:
+    free(got);
+    _exit(0);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// закрываем все дескрипторы от 3 и выше, кроме нужных помощнику
+static void keep_only(int in, FanTarget *t, int n) {
+    int *keep = malloc(sizeof(int) * (3 * n + 1));
+    if (!keep) return;
+
+    int k = 0;
+    keep[k++] = in;
+    for (int i = 0; i < n; ++i) {
+        keep[k++] = t[i].fd;
+        if (t[i].pipe[0] >= 0) keep[k++] = t[i].pipe[0];
+        if (t[i].pipe[1] >= 0) keep[k++] = t[i].pipe[1];
+    }
+    qsort(keep, k, sizeof(int), cmp_int);
+
+    unsigned int from = 3;
+    for (int i = 0; i < k; ++i) {
+        if ((unsigned int)keep[i] > from) close_range(from, keep[i] - 1, 0);
+        if ((unsigned int)keep[i] + 1 > from) from = keep[i] + 1;
+    }
+    close_range(from, ~0U, 0);
+    free(keep);
+}
+
+static int is_member(Redirection *leader, Redirection *r) {
+    return r == leader || (r->multios == MULTIOS_MEMBER && r->fd == leader->fd &&
+                           (r->type == REDIR_OUT || r->type == REDIR_APPEND));
+}
+
+// открываем все файлы группы и запускаем помощника; в leader->src_fd - вход пайпа
+static int start_group(Redirection *leader) {
+    int n = 0;
+    for (Redirection *r = leader; r; r = r->next) {
+        if (is_member(leader, r)) n++;
+    }
+
+    if (n_helpers >= MULTIOS_MAX_HELPERS) {
+        fprintf(stderr, "multios: too many groups\n");
+        return 1;
+    }
+
+    FanTarget *t = calloc(n, sizeof(FanTarget));
+    if (!t) {
+        perror("calloc");
+        return 1;
+    }
+
+    int opened = 0, rc = 1;
+    int p[2] = { -1, -1 };
+
+    for (Redirection *r = leader; r; r = r->next) {
+        if (!is_member(leader, r)) continue;
+
+        char *name = needs_expansion(r->filename) ? expand_word(r->filename, EXPAND_WORD) : r->filename;
+        if (!name) goto out;
+
+        t[opened].fd = open(name, r->open_flags | O_CLOEXEC, 0644);
+        if (t[opened].fd < 0) perror(name);
+        if (name != r->filename) free(name);
+        if (t[opened].fd < 0) goto out;
+
+        t[opened].splice = !(r->open_flags & O_APPEND);
+        t[opened].pipe[0] = t[opened].pipe[1] = -1;
+        opened++;
+    }
+
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("pipe");
+        goto out;
+    }
+
+    // промежуточные пайпы не меньше входного, чтобы tee отдавал порцию целиком
+    int size = fcntl(p[0], F_GETPIPE_SZ);
+    for (int k = 0; k < n - 1; ++k) {
+        if (pipe2(t[k].pipe, O_CLOEXEC) < 0) {
+            perror("pipe");
+            goto out;
+        }
+        if (size > 0) fcntl(t[k].pipe[1], F_SETPIPE_SZ, size);
+    }
+
+    out_flush_all();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        goto out;
+    }
+
+    if (pid == 0) {
+        // помощнику нужны только вход и цели: чужие концы пайпов (конвейера, других
+        // групп) держать нельзя - иначе их читатели не увидят EOF
+        close(p[1]);
+        keep_only(p[0], t, n);
+        fanout(p[0], t, n);
+    }
+
+    helpers[n_helpers].pid = pid;
+    helpers[n_helpers].wfd = p[1];
+    n_helpers++;
+
+    leader->src_fd = p[1];
+    p[1] = -1;
+    rc = 0;
+
+out:
+    if (p[0] >= 0) close(p[0]);
+    if (p[1] >= 0) close(p[1]);
+    for (int k = 0; k < opened; ++k) {
+        close(t[k].fd);
+        if (t[k].pipe[0] >= 0) close(t[k].pipe[0]);
+        if (t[k].pipe[1] >= 0) close(t[k].pipe[1]);
+    }
+    free(t);
+    return rc;
+}
+
+// до fork: для каждой группы multios из списка запускаем помощника
+int multios_prepare(Redirection *redir) {
+    for (Redirection *r = redir; r; r = r->next) {
+        if (r->multios != MULTIOS_LEADER || r->src_fd >= 0) continue;
+        if (start_group(r) != 0) {
+            multios_release(redir);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// после fork (или после встроенной команды) закрываем входы пайпов в шелле
+void multios_release(Redirection *redir) {
+    for (Redirection *r = redir; r; r = r->next) {
+        if (r->multios != MULTIOS_LEADER || r->src_fd < 0) continue;
+
+        for (int i = 0; i < n_helpers; ++i) {
+            if (helpers[i].wfd == r->src_fd) helpers[i].wfd = -1;
+        }
+        close(r->src_fd);
+        r->src_fd = -1;
+    }
+}
+
+// block = 0 - задание остановили: помощники допишут сами, когда оно продолжится.
+// Помощники с неотпущенным входом (группа { ...; } >a >b вокруг текущей команды)
+// не трогаем: они закончат только после multios_release своей группы
+void multios_wait(int block) {
+    int kept = 0;
+    for (int i = 0; i < n_helpers; ++i) {
+        if (helpers[i].wfd >= 0) {
+            helpers[kept++] = helpers[i];
+            continue;
+        }
+        if (block) {
+            while (waitpid(helpers[i].pid, NULL, 0) < 0 && errno == EINTR);
+        } else {
+            waitpid(helpers[i].pid, NULL, WNOHANG);
+        }
+    }
+    n_helpers = kept;
+}
@@ -0,0 +1,90 @@
+#include "../inc/mybash.h"
+#include "../inc/shell.h"
+#include "../inc/lexer.h"
+#include "../inc/parser.h"
+#include "../inc/execution.h"
+#include "../inc/outbuf.h"
+#include "../inc/optimize.h"
+#include "../inc/zygote.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+MyBash *mybash_new(int flags) {
+    MyBash *sh = calloc(1, sizeof(MyBash));
+    if (!sh) {
+        perror("malloc");
+        return NULL;
+    }
+    options_init(sh->options);
+
+    g_sh = sh;
+    init_shell(flags & MYBASH_JOB_CONTROL);
+    return sh;
+}
+
+void mybash_free(MyBash *sh) {
+    if (!sh) return;
+
+    MyBash *prev = g_sh;
+    g_sh = sh;
+    out_flush_all();
+    // задания не трогаем, только забываем о них
+    while (sh->first_job) delete_job(sh->first_job->pgid);
+    g_sh = prev == sh ? NULL : prev;
+    free(sh->pipestatus);
+    free(sh);
+}
+
+// дальнейшие tokenize/parse/execute относятся к этому экземпляру
+void mybash_use(MyBash *sh) {
+    g_sh = sh;
+}
+
+int mybash_execute(MyBash *sh, ASTNode *ast) {
+    g_sh = sh;
+    sh->exited = 0;
+    int rc = execute(ast);
+    out_flush_all();
+    return rc;
+}
+
+// строка целиком: разбор, optimize и выполнение; 2 - синтаксическая ошибка
+int mybash_run(MyBash *sh, const char *line, int flags) {
+    g_sh = sh;
+    sh->exited = 0;
+    Token *tokens = tokenize(line);
+    if (!tokens) return sh->last_status = 2;
+
+    int rc = 0;
+    ASTNode *ast = optimize_ast(parse(tokens));
+    if (ast) {
+        rc = (flags & MYBASH_RUN_TAIL) ? execute_tail(ast) : execute(ast);
+        free_ast(ast);
+    } else if (tokens[0].type != TOKEN_EOF) {
+        rc = sh->last_status = 2;
+    }
+
+    free_tokens(tokens);
+    out_flush_all();
+    return rc;
+}
+
+int mybash_status(MyBash *sh) {
+    return sh->last_status;
+}
+
+// последний tokenize оборвался на незакрытых кавычках или here-document:
+// строку нужно дочитать и разобрать заново
+int mybash_incomplete(MyBash *sh) {
+    return sh->unclosed_quote || sh->unclosed_heredoc;
+}
+
+int mybash_exited(MyBash *sh) {
+    return sh->exited;
+}
+
+int mybash_zygote(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], ZYGOTE_ARG) == 0) return zygote_main(ZYGOTE_FD);
+    return -1;
+}
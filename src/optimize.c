@@ -0,0 +1,238 @@
+#include "../inc/optimize.h"
+#include "../inc/builtin.h"
+#include "../inc/expand.h"
+#include "../inc/options.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int debug;
+
+// текст узла до переписывания - только для отчета
+static char *snapshot(ASTNode *node) {
+    return debug ? ast_to_string(node) : NULL;
+}
+
+static void report(const char *rule, char *before, ASTNode *after) {
+    if (!debug) return;
+    char *text = ast_to_string(after);
+    fprintf(stderr, "optimize: %s: %s => %s\n", rule, before ? before : "?", text ? text : "?");
+    free(text);
+    free(before);
+}
+
+// слова и имена файлов без подстановок: переписывание не меняет, что и когда раскрывается
+static int command_is_static(ASTNode *cmd) {
+    for (int i = 0; i < cmd->command.argc; ++i) {
+        if (needs_expansion(cmd->command.argv[i])) return 0;
+    }
+    for (Redirection *r = cmd->command.redir; r; r = r->next) {
+        if (needs_expansion(r->filename)) return 0;
+    }
+    return 1;
+}
+
+// команда ровно из слов words, без перенаправлений
+static int is_plain(ASTNode *node, const char *name, int argc) {
+    return node && node->type == NODE_COMMAND && node->command.argc == argc &&
+           !node->command.redir && strcmp(node->command.argv[0], name) == 0 && command_is_static(node);
+}
+
+// пометки multios зависят от соседей - после правки списка план собирается заново
+static void replan(Redirection *redir, RedirPlan *plan) {
+    for (Redirection *r = redir; r; r = r->next) r->multios = MULTIOS_NONE;
+    free_redir_plan(plan);
+    compile_redir_plan(redir, plan);
+}
+
+static Redirection **node_redirs(ASTNode *node, RedirPlan **plan) {
+    if (node->type == NODE_COMMAND) {
+        *plan = &node->command.plan;
+        return &node->command.redir;
+    }
+    if (node->type == NODE_GROUP || node->type == NODE_SUB) {
+        *plan = &node->unary.plan;
+        return &node->unary.redir;
+    }
+    return NULL;
+}
+
+// redir выполняются раньше собственных перенаправлений узла
+static int prepend_redirs(ASTNode *node, Redirection *redir) {
+    RedirPlan *plan;
+    Redirection **head = node_redirs(node, &plan);
+    if (!head) return 0;
+
+    Redirection *tail = redir;
+    while (tail->next) tail = tail->next;
+    tail->next = *head;
+    *head = redir;
+
+    replan(*head, plan);
+    return 1;
+}
+
+// >f >f в один и тот же дескриптор: первый open сразу заменяется вторым - убираем повтор.
+// >f 2>f не трогаем: у двух open свои смещения, и 2>&1 вместо них поменял бы вывод
+static int merge_redirs(Redirection **head) {
+    int changed = 0;
+
+    for (Redirection *r = *head; r && r->next; ) {
+        Redirection *n = r->next;
+        int same = (r->type == REDIR_OUT || r->type == REDIR_APPEND) && n->type == r->type &&
+                   n->fd == r->fd && strcmp(r->filename, n->filename) == 0 && !needs_expansion(r->filename);
+        if (!same) {
+            r = n;
+            continue;
+        }
+
+        r->next = n->next;
+        n->next = NULL;
+        free_redir(n);
+        changed = 1;
+    }
+    return changed;
+}
+
+static void merge_node_redirs(ASTNode *node) {
+    RedirPlan *plan;
+    Redirection **head = node_redirs(node, &plan);
+    if (!head || !*head) return;
+
+    char *before = snapshot(node);
+    if (merge_redirs(head)) {
+        replan(*head, plan);
+        report("merge redirections", before, node);
+    } else {
+        free(before);
+    }
+}
+
+// стадия-встроенная без побочных эффектов: последнюю конвейер выполнит в самом шелле
+static void mark_pure(ASTNode *stage) {
+    if (!stage || stage->type != NODE_COMMAND || !stage->command.argv[0]) return;
+    if (needs_expansion(stage->command.argv[0])) return;
+
+    const Builtin *b = find_builtin(stage->command.argv[0]);
+    if (b && (b->flags & BUILTIN_NOFORK)) stage->command.pure = 1;
+}
+
+static ASTNode *optimize_node(ASTNode *node) {
+    if (!node) return NULL;
+
+    switch (node->type) {
+        case NODE_COMMAND:
+            merge_node_redirs(node);
+            return node;
+
+        case NODE_PIPE:
+        case NODE_PIPE_STDERR: {
+            node->binary.left = optimize_node(node->binary.left);
+            node->binary.right = optimize_node(node->binary.right);
+            mark_pure(node->binary.left);
+            mark_pure(node->binary.right);
+
+            // cat file | cmd -> cmd < file. Только первая стадия: у средней cat
+            // вход не читает, и её убирание поменяло бы судьбу левой части
+            ASTNode *left = node->binary.left;
+            ASTNode *right = node->binary.right;
+            if (node->type == NODE_PIPE && is_plain(left, "cat", 2) && left->command.argv[1][0] != '-' && right) {
+                char *before = snapshot(node);
+
+                Redirection *in = NULL;
+                add_redir(&in, REDIR_IN, 0, left->command.argv[1]);
+                if (in && prepend_redirs(right, in)) {
+                    free_ast(left);
+                    free(node);
+                    report("cat file | cmd", before, right);
+                    return right;
+                }
+                free_redir(in);
+                free(before);
+            }
+            return node;
+        }
+
+        case NODE_SEQUENCE:
+            node->binary.left = optimize_node(node->binary.left);
+            node->binary.right = optimize_node(node->binary.right);
+            return node;
+
+        // true && x -> x, false && x -> false, false || x -> x, true || x -> true
+        case NODE_AND:
+        case NODE_OR: {
+            node->binary.left = optimize_node(node->binary.left);
+            node->binary.right = optimize_node(node->binary.right);
+
+            ASTNode *left = node->binary.left;
+            int is_true = is_plain(left, "true", 1);
+            int is_false = is_plain(left, "false", 1);
+            if (!is_true && !is_false) return node;
+
+            char *before = snapshot(node);
+            int take_right = (node->type == NODE_AND) == is_true;
+            ASTNode *keep = take_right ? node->binary.right : left;
+            free_ast(take_right ? left : node->binary.right);
+            free(node);
+            report(take_right ? "constant condition" : "dead branch", before, keep);
+            return keep;
+        }
+
+        // ( cmd ) -> cmd: внешняя команда без подстановок в подоболочке ничего не меняет
+        case NODE_SUB: {
+            node->unary.child = optimize_node(node->unary.child);
+            merge_node_redirs(node);
+
+            ASTNode *child = node->unary.child;
+            if (!child || child->type != NODE_COMMAND || !child->command.argv[0] || !command_is_static(child)) {
+                return node;
+            }
+            const Builtin *b = find_builtin(child->command.argv[0]);
+            if (b && !(b->flags & BUILTIN_NOFORK)) return node; // cd, exit, set - только внутри ()
+
+            char *before = snapshot(node);
+            if (node->unary.redir) {
+                prepend_redirs(child, node->unary.redir);
+                node->unary.redir = NULL;
+            }
+            free_redir_plan(&node->unary.plan);
+            free(node);
+            report("unwrap subshell", before, child);
+            return child;
+        }
+
+        // { cmd; } >f -> cmd >f
+        case NODE_GROUP: {
+            node->unary.child = optimize_node(node->unary.child);
+            merge_node_redirs(node);
+
+            // список без перенаправлений и так выполняется в шелле - группа лишняя
+            ASTNode *child = node->unary.child;
+            if (!child || (node->unary.redir && child->type != NODE_COMMAND)) return node;
+
+            char *before = snapshot(node);
+            if (node->unary.redir) {
+                prepend_redirs(child, node->unary.redir);
+                node->unary.redir = NULL;
+            }
+            free_redir_plan(&node->unary.plan);
+            free(node);
+            report("unwrap group", before, child);
+            return child;
+        }
+
+        case NODE_BACKGROUND:
+            node->unary.child = optimize_node(node->unary.child);
+            return node;
+
+        case NODE_ARITH:
+            return node;
+    }
+    return node;
+}
+
+ASTNode *optimize_ast(ASTNode *node) {
+    if (!get_option(OPT_OPTIMIZE)) return node;
+    debug = get_option(OPT_OPTIMIZE_DEBUG);
+    return optimize_node(node);
+}
@@ -0,0 +1,108 @@
+#include "../inc/options.h"
+#include "../inc/outbuf.h"
+#include "../inc/shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    const char *name;
+    int enabled;     // значение по умолчанию
+    int has_value;   // опция вида name=N
+    long value;
+} OptionInfo;
+
+// порядок совпадает с ShellOption; текущие значения - в g_sh->options
+static const OptionInfo options[OPT_COUNT] = {
+    [OPT_BUILTIN_UTILS] = { "builtin-utils", 1, 0, 0 },
+    [OPT_PIPESIZE]      = { "pipesize", 0, 1, 0 },
+    [OPT_PIPEFAIL]      = { "pipefail", 0, 0, 0 },
+    [OPT_CPUSPREAD]     = { "cpuspread", 0, 0, 0 },
+    [OPT_BGNICE]        = { "bgnice", 0, 1, 5 },
+    [OPT_OPTIMIZE]      = { "optimize", 0, 0, 0 },
+    [OPT_OPTIMIZE_DEBUG] = { "optimize-debug", 0, 0, 0 },
+    [OPT_ZYGOTE]        = { "zygote", 0, 0, 0 },
+};
+
+void options_init(OptionState *state) {
+    for (int i = 0; i < OPT_COUNT; ++i) {
+        state[i].enabled = options[i].enabled;
+        state[i].value = options[i].value;
+    }
+}
+
+int get_option(ShellOption opt) {
+    if (opt < 0 || opt >= OPT_COUNT) return 0;
+    return g_sh->options[opt].enabled;
+}
+
+long get_option_value(ShellOption opt) {
+    if (opt < 0 || opt >= OPT_COUNT) return 0;
+    return g_sh->options[opt].enabled ? g_sh->options[opt].value : 0;
+}
+
+// размер: число с необязательным суффиксом k, m или g (степени 1024)
+int parse_size(const char *s, long *out) {
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (end == s || v < 0) return 1;
+
+    if (*end == 'k' || *end == 'K') {
+        v *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        v *= 1024 * 1024;
+        end++;
+    } else if (*end == 'g' || *end == 'G') {
+        v *= 1024L * 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0') return 1;
+
+    *out = v;
+    return 0;
+}
+
+// spec - "name" или "name=value", enable - set -o (1) / set +o (0)
+int set_option(const char *spec, int enable) {
+    const char *eq = strchr(spec, '=');
+    size_t name_len = eq ? (size_t)(eq - spec) : strlen(spec);
+
+    for (int i = 0; i < OPT_COUNT; ++i) {
+        if (strlen(options[i].name) != name_len || strncmp(options[i].name, spec, name_len) != 0) {
+            continue;
+        }
+
+        if (eq && !options[i].has_value) {
+            out_errorf("set: option %s takes no value\n", options[i].name);
+            return 1;
+        }
+
+        if (eq && enable) {
+            long v;
+            if (parse_size(eq + 1, &v) != 0) {
+                out_errorf("set: bad value for %s: %s\n", options[i].name, eq + 1);
+                return 1;
+            }
+            g_sh->options[i].value = v;
+        }
+
+        g_sh->options[i].enabled = enable;
+        return 0;
+    }
+
+    out_errorf("set: unknown option: %.*s\n", (int)name_len, spec);
+    return 1;
+}
+
+void print_options(void) {
+    for (int i = 0; i < OPT_COUNT; ++i) {
+        const OptionState *st = &g_sh->options[i];
+        if (options[i].has_value && st->enabled) {
+            out_printf(STDOUT_FILENO, "%-16s on (%ld)\n", options[i].name, st->value);
+        } else {
+            out_printf(STDOUT_FILENO, "%-16s %s\n", options[i].name, st->enabled ? "on" : "off");
+        }
+    }
+}
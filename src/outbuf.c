@@ -0,0 +1,212 @@
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+// буферизуем только stdout и stderr, остальные дескрипторы пишутся напрямую
+#define OUTBUF_FDS 3
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int capturing; // вывод stdout перехвачен в память (подстановка $(...))
+} OutBuf;
+
+static OutBuf bufs[OUTBUF_FDS];
+
+static OutBuf *get_buf(int fd) {
+    if (fd < 1 || fd >= OUTBUF_FDS) return NULL;
+
+    OutBuf *b = &bufs[fd];
+    if (!b->data) {
+        b->data = malloc(OUTBUF_SIZE);
+        if (!b->data) return NULL;
+        b->len = 0;
+        b->cap = OUTBUF_SIZE;
+    }
+    return b;
+}
+
+// в режиме перехвата буфер растет, а не сбрасывается
+static int grow_capture(OutBuf *b, size_t need) {
+    if (b->len + need <= b->cap) return 0;
+
+    size_t cap = b->cap ? b->cap : OUTBUF_SIZE;
+    while (b->len + need > cap) cap *= 2;
+
+    char *data = realloc(b->data, cap);
+    if (!data) return -1;
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+void out_capture_begin(OutCapture *saved) {
+    OutBuf *b = &bufs[STDOUT_FILENO];
+
+    saved->data = b->data;
+    saved->len = b->len;
+    saved->cap = b->cap;
+    saved->capturing = b->capturing;
+
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+    b->capturing = 1;
+}
+
+// возвращает перехваченный вывод (владение переходит вызывающему) и восстанавливает stdout
+char *out_capture_end(OutCapture *saved, size_t *len) {
+    OutBuf *b = &bufs[STDOUT_FILENO];
+
+    char *data = b->data;
+    *len = b->len;
+    if (!data) data = malloc(1);
+
+    b->data = saved->data;
+    b->len = saved->len;
+    b->cap = saved->cap;
+    b->capturing = saved->capturing;
+    return data;
+}
+
+// записываем все iov целиком, догоняя частичные записи
+static int write_all_iov(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int out_flush(int fd) {
+    if (fd < 1 || fd >= OUTBUF_FDS || !bufs[fd].data || bufs[fd].len == 0 || bufs[fd].capturing) return 0;
+
+    OutBuf *b = &bufs[fd];
+    struct iovec iov = { b->data, b->len };
+    b->len = 0; // при ошибке (EPIPE и т.п.) данные всё равно выбрасываем
+    return write_all_iov(fd, &iov, 1);
+}
+
+void out_flush_all(void) {
+    // сначала stdio шелла (приглашение, дерево), потом буферы встроенных команд
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 1; fd < OUTBUF_FDS; ++fd) {
+        out_flush(fd);
+    }
+}
+
+int out_write(int fd, const void *data, size_t len) {
+    OutBuf *b = get_buf(fd);
+    if (!b) {
+        struct iovec iov = { (void *)data, len };
+        return write_all_iov(fd, &iov, 1);
+    }
+
+    if (b->capturing && grow_capture(b, len) < 0) return -1;
+
+    if (b->len + len <= b->cap) {
+        memcpy(b->data + b->len, data, len);
+        b->len += len;
+        return 0;
+    }
+
+    // большой кусок: накопленное и новое одним writev, без лишнего копирования
+    if (len >= OUTBUF_SIZE / 2) {
+        struct iovec iov[2] = {
+            { b->data, b->len },
+            { (void *)data, len },
+        };
+        b->len = 0;
+        return write_all_iov(fd, iov, 2);
+    }
+
+    int rc = out_flush(fd);
+    memcpy(b->data, data, len);
+    b->len = len;
+    return rc;
+}
+
+// Диагностика встроенных команд: сначала всё накопленное, чтобы сообщение
+// встало в выводе на свое место, потом сразу в stderr.
+int out_errorf(const char *fmt, ...) {
+    out_flush_all();
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+void out_perror(const char *s) {
+    int err = errno;
+    out_flush_all();
+    errno = err;
+    perror(s);
+}
+
+int out_puts(int fd, const char *s) {
+    return out_write(fd, s, strlen(s));
+}
+
+int out_putc(int fd, char c) {
+    OutBuf *b = get_buf(fd);
+    if (b && b->len < b->cap) {
+        b->data[b->len++] = c;
+        return 0;
+    }
+    return out_write(fd, &c, 1);
+}
+
+int out_printf(int fd, const char *fmt, ...) {
+    OutBuf *b = get_buf(fd);
+    va_list ap;
+
+    // пробуем отформатировать прямо в свободное место буфера
+    if (b) {
+        size_t room = b->cap - b->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->len, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return -1;
+        if ((size_t)n < room) {
+            b->len += n;
+            return n;
+        }
+    }
+
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+
+    char *tmp = malloc((size_t)n + 1);
+    if (!tmp) return -1;
+
+    va_start(ap, fmt);
+    vsnprintf(tmp, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+
+    int rc = out_write(fd, tmp, n);
+    free(tmp);
+    return rc < 0 ? -1 : n;
+}
@@ -1,9 +1,24 @@
 #include "../inc/parser.h"
+#include "../inc/options.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 
+static int is_redir_token(TokenType);
+static int parse_redirection(Token **, Redirection **);
+
+// { и } - зарезервированные слова только там, где ожидается команда
+static int is_reserved(Token *t, const char *word) {
+    return t -> type == TOKEN_WORD && strcmp(t -> value, word) == 0;
+}
+
+// список кончается на конце ввода, ')' или '}'
+static int at_list_end(Token *t) {
+    return t -> type == TOKEN_EOF || t -> type == TOKEN_RPAREN || is_reserved(t, "}");
+}
+
 ASTNode *parse(Token *tokens){
     if(!tokens || tokens[0].type == TOKEN_EOF){
         return NULL;
@@ -29,7 +44,7 @@ ASTNode *parse_list(Token **curr){
             if((*curr) -> type == TOKEN_SEMICOL) (*curr)++;
 
             // если есть еще команды, парсим их и соединяем через ;
-            if ((*curr)->type != TOKEN_EOF && (*curr)->type != TOKEN_RPAREN) {
+            if (!at_list_end(*curr)) {
                 ASTNode *right = parse_list(curr);
                 if (right){
                     left = create_binary(NODE_SEQUENCE, left, right);
@@ -39,8 +54,8 @@ ASTNode *parse_list(Token **curr){
             return left;
             
         } else if(match(curr, TOKEN_SEMICOL)){ // ; 
-            // Если ';' в конце или перед ')', просто возвращаем левую часть
-            if ((*curr) -> type == TOKEN_EOF  || (*curr)->type == TOKEN_RPAREN){
+            // Если ';' в конце или перед ')' и '}', просто возвращаем левую часть
+            if (at_list_end(*curr)){
                 return left;
             }
 
@@ -88,6 +103,26 @@ ASTNode *parse_logical(Token **curr){
 }
 
 ASTNode *parse_pipeline(Token **curr){
+    // pipesize N cmd | cmd - емкость пайпов только для этого конвейера.
+    // Без | или |& дальше это не приставка: молча терять её нельзя - ошибка;
+    // программу с таким именем можно запустить, взяв имя в кавычки
+    long pipe_size = 0;
+    if ((*curr) -> type == TOKEN_WORD && strcmp((*curr) -> value, "pipesize") == 0 &&
+        (*curr)[1].type == TOKEN_WORD && parse_size((*curr)[1].value, &pipe_size) == 0 &&
+        pipe_size > 0 && pipe_size <= INT_MAX && (*curr)[2].type != TOKEN_EOF) {
+        const char *size = (*curr)[1].value;
+        (*curr) += 2;
+        ASTNode *node = parse_pipeline(curr);
+        if (!node) return NULL;
+        if (node -> type != NODE_PIPE && node -> type != NODE_PIPE_STDERR) {
+            fprintf(stderr, "Syntax error: pipesize %s: no pipeline follows\n", size);
+            free_ast(node);
+            return NULL;
+        }
+        node -> binary.pipe_size = (int)pipe_size;
+        return node;
+    }
+
     ASTNode *left = parse_factor(curr);
     if (!left) return NULL;
 
@@ -112,7 +147,46 @@ ASTNode *parse_pipeline(Token **curr){
 
 }
 
+// ( list ) >file, { list; } >file: перенаправления на всю группу
+static ASTNode *parse_group_redirs(Token **curr, ASTNode *node) {
+    if (!node) return NULL;
+
+    Redirection *redir = NULL;
+    while ((*curr) -> type == TOKEN_IO_NUMBER || is_redir_token((*curr) -> type)) {
+        if (parse_redirection(curr, &redir) != 0) {
+            free_redir(redir);
+            free_ast(node);
+            return NULL;
+        }
+    }
+    if (redir) set_unary_redir(node, redir);
+    return node;
+}
+
 ASTNode *parse_factor(Token **curr){
+    // { list; } - группа в текущем шелле
+    if (is_reserved(*curr, "{")) {
+        (*curr)++;
+
+        ASTNode *inner = parse_list(curr);
+        if (!inner) {
+            fprintf(stderr, "error inside {}\n");
+            return NULL;
+        }
+
+        if (!is_reserved(*curr, "}")) {
+            fprintf(stderr, "Syntax error: expected '}'\n");
+            free_ast(inner);
+            return NULL;
+        }
+        (*curr)++;
+
+        return parse_group_redirs(curr, create_unary(NODE_GROUP, inner));
+    }
+
+    // '}' без '{' - не команда
+    if (is_reserved(*curr, "}")) return NULL;
+
     if((*curr) -> type == TOKEN_LPAREN) { 
         (*curr)++; // Пропускаем '('
 
@@ -129,18 +203,119 @@ ASTNode *parse_factor(Token **curr){
         }
         (*curr)++; 
 
-        return create_unary(NODE_SUB, inner);
+        return parse_group_redirs(curr, create_unary(NODE_SUB, inner));
+    }
+
+    if((*curr) -> type == TOKEN_ARITH) {
+        ASTNode *node = create_arith((*curr) -> value);
+        (*curr)++;
+        return node;
     }
 
     return parse_simple_command(curr);
 }
 
 
+static int is_redir_token(TokenType t) {
+    return t == TOKEN_REDIR_IN || t == TOKEN_REDIR_OUT || t == TOKEN_REDIR_APPEND ||
+           t == TOKEN_AMPER_REDIR_IN || t == TOKEN_AMPER_REDIR_APPEND ||
+           t == TOKEN_REDIR_DUP_OUT || t == TOKEN_REDIR_DUP_IN || t == TOKEN_REDIR_RDWR ||
+           t == TOKEN_HEREDOC || t == TOKEN_HEREDOC_RAW || t == TOKEN_HERESTRING;
+}
+
+static int is_number(const char *s) {
+    if (!s || !*s) return 0;
+    for (; *s; ++s) {
+        if (*s < '0' || *s > '9') return 0;
+    }
+    return 1;
+}
+
+static Redirection *redir_last(Redirection *head) {
+    while (head && head -> next) head = head -> next;
+    return head;
+}
+
+// разбираем одно перенаправление: [n]op word
+static int parse_redirection(Token **curr, Redirection **redir_head) {
+    int fd = -1;
+    if ((*curr) -> type == TOKEN_IO_NUMBER) {
+        fd = atoi((*curr) -> value);
+        (*curr)++;
+        if (!is_redir_token((*curr) -> type)) {
+            fprintf(stderr, "Syntax error: expected redirection after %d\n", fd);
+            return 1;
+        }
+    }
+
+    TokenType op = (*curr) -> type;
+
+    // у here-document лексер уже положил тело в значение токена
+    if (op == TOKEN_HEREDOC || op == TOKEN_HEREDOC_RAW) {
+        add_redir(redir_head, REDIR_HEREDOC, fd, (*curr) -> value);
+        redir_last(*redir_head) -> expand = (op == TOKEN_HEREDOC) ? HEREDOC_EXPAND_BODY : HEREDOC_EXPAND_NONE;
+        (*curr)++;
+        return 0;
+    }
+
+    (*curr)++; // пропускаем символ перенаправления
+
+    // проверяем, что после перенаправления идет имя файла
+    if ((*curr) -> type != TOKEN_WORD && (*curr) -> type != TOKEN_WORD_IN_QUOTES) {
+        fprintf(stderr, "Syntax error: expected filename\n");
+        return 1;
+    }
+    const char *word = (*curr) -> value;
+    (*curr)++; // пропускаем имя файла
+
+    // <<<word - тело из одного слова с переводом строки
+    if (op == TOKEN_HERESTRING) {
+        size_t wl = strlen(word);
+        char *body = malloc(wl + 2);
+        if (!body) return 1;
+        memcpy(body, word, wl);
+        body[wl] = '\n';
+        body[wl + 1] = '\0';
+        add_redir(redir_head, REDIR_HEREDOC, fd, body);
+        redir_last(*redir_head) -> expand = HEREDOC_EXPAND_WORD;
+        free(body);
+        return 0;
+    }
+
+    // определяем тип перенаправления
+    RedirType r_type;
+    switch (op) {
+        case TOKEN_REDIR_IN: r_type = REDIR_IN; break;           // <
+        case TOKEN_REDIR_OUT: r_type = REDIR_OUT; break;         // >
+        case TOKEN_REDIR_APPEND: r_type = REDIR_APPEND; break;   // >>
+        case TOKEN_AMPER_REDIR_IN: r_type = REDIR_ERR_OUT; break; // &>
+        case TOKEN_AMPER_REDIR_APPEND: r_type = REDIR_ERR_APPEND; break; // &>>
+        case TOKEN_REDIR_RDWR: r_type = REDIR_RDWR; break;       // <>
+        case TOKEN_REDIR_DUP_OUT:                                // n>&m, n>&-
+        case TOKEN_REDIR_DUP_IN:                                 // n<&m, n<&-
+            if (strcmp(word, "-") == 0) {
+                r_type = REDIR_CLOSE;
+            } else if (is_number(word)) {
+                r_type = REDIR_DUP;
+            } else if (op == TOKEN_REDIR_DUP_OUT && fd < 0) {
+                r_type = REDIR_ERR_OUT; // >&file - то же, что &>file
+            } else {
+                fprintf(stderr, "%s: ambiguous redirect\n", word);
+                return 1;
+            }
+            if (fd < 0 && r_type != REDIR_ERR_OUT) fd = (op == TOKEN_REDIR_DUP_IN) ? 0 : 1;
+            break;
+        default: r_type = REDIR_OUT; break;
+    }
+
+    // добавляем перенаправление в связный список
+    add_redir(redir_head, r_type, fd, word);
+    return 0;
+}
+
 ASTNode *parse_simple_command(Token **curr) {
     if ((*curr) -> type != TOKEN_WORD && (*curr) -> type != TOKEN_WORD_IN_QUOTES && 
-        (*curr) -> type != TOKEN_REDIR_IN && (*curr) -> type != TOKEN_REDIR_OUT && 
-        (*curr) -> type != TOKEN_REDIR_APPEND && (*curr) -> type != TOKEN_AMPER_REDIR_IN && 
-        (*curr) -> type != TOKEN_AMPER_REDIR_APPEND) {
+        (*curr) -> type != TOKEN_IO_NUMBER && !is_redir_token((*curr) -> type)) {
         return NULL;
     }
 
@@ -161,29 +336,11 @@ ASTNode *parse_simple_command(Token **curr) {
             argv[argc++] = strdup((*curr) -> value);
             (*curr)++;
         } // обрабатываем перенаправления 
-        else if ((*curr) -> type == TOKEN_REDIR_IN || (*curr) -> type == TOKEN_REDIR_OUT || 
-                (*curr) -> type == TOKEN_REDIR_APPEND || (*curr) -> type == TOKEN_AMPER_REDIR_IN || 
-                (*curr) -> type == TOKEN_AMPER_REDIR_APPEND) {
-            
-            // определяем тип перенаправления
-            RedirType r_type;
-            switch ((*curr) -> type) {
-                case TOKEN_REDIR_IN: r_type = REDIR_IN; break;           // <
-                case TOKEN_REDIR_OUT: r_type = REDIR_OUT; break;         // >
-                case TOKEN_REDIR_APPEND: r_type = REDIR_APPEND; break;   // >>
-                case TOKEN_AMPER_REDIR_IN: r_type = REDIR_ERR_OUT; break; // &>
-                case TOKEN_AMPER_REDIR_APPEND: r_type = REDIR_ERR_APPEND; break; // &>>
-                default: r_type = REDIR_OUT; break;
-            }
-            (*curr)++; // пропускаем символ перенаправления (<, >, >>, &>, &>>)
-
-            // проверяем, что после перенаправления идет имя файла
-            if ((*curr) -> type == TOKEN_WORD || (*curr) -> type == TOKEN_WORD_IN_QUOTES) {
-                // добавляем перенаправление в связный список
-                add_redir(&redir_head, r_type, (*curr) -> value);
-                (*curr)++; // пропускаем имя файла
-            } else {
-                fprintf(stderr, "Syntax error: expected filename\n");
+        else if ((*curr) -> type == TOKEN_IO_NUMBER || is_redir_token((*curr) -> type)) {
+            if (parse_redirection(curr, &redir_head) != 0) {
+                for (int i = 0; i < argc; ++i) free(argv[i]);
+                free(argv);
+                free_redir(redir_head);
                 return NULL;
             }
         } else {
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+
+#include "../inc/procsubst.h"
+#include "../inc/lexer.h"
+#include "../inc/parser.h"
+#include "../inc/optimize.h"
+#include "../inc/execution.h"
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern int shell_is_interactive;
+
+#define PROCSUBST_MAX 32
+
+// помощники текущей команды: до её fork держим наши концы пайпов
+static int ps_fds[PROCSUBST_MAX];
+static pid_t ps_pids[PROCSUBST_MAX];
+static int ps_count = 0;
+static pid_t ps_pgid = 0; // группа задания, её создает первый помощник
+
+// запускаем cmd с пайпом и возвращаем путь /dev/fd/N для нашего конца.
+// to_cmd - форма >(cmd): команда пишет в N, помощник читает
+char *procsubst_open(const char *cmd, int to_cmd) {
+    if (ps_count >= PROCSUBST_MAX) {
+        fprintf(stderr, "process substitution: too many\n");
+        return NULL;
+    }
+
+    // O_CLOEXEC: другие помощники не должны держать чужие концы
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return NULL;
+    }
+
+    out_flush_all();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(p[0]);
+        close(p[1]);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        if (shell_is_interactive) setpgid(0, ps_pgid);
+        shell_is_interactive = 0;
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+
+        dup2(to_cmd ? p[0] : p[1], to_cmd ? STDIN_FILENO : STDOUT_FILENO);
+
+        // помощник не запускает exec сам, так что лишние концы закрываем руками:
+        // иначе читатель >(cmd) не дождется EOF
+        close(p[0]);
+        close(p[1]);
+        for (int i = 0; i < ps_count; ++i) close(ps_fds[i]);
+        ps_count = 0;
+
+        Token *tokens = tokenize(cmd);
+        ASTNode *ast = tokens ? optimize_ast(parse(tokens)) : NULL;
+        if (!ast) _exit(2);
+        _exit(execute_internal(ast, 1));
+    }
+
+    if (shell_is_interactive) {
+        setpgid(pid, ps_pgid ? ps_pgid : pid);
+        if (!ps_pgid) ps_pgid = pid;
+    }
+
+    int keep = to_cmd ? p[1] : p[0];
+    close(to_cmd ? p[0] : p[1]);
+
+    ps_fds[ps_count] = keep;
+    ps_pids[ps_count] = pid;
+    ps_count++;
+
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", keep);
+    return strdup(path);
+}
+
+// группа, в которую должна встать команда (0 - помощников нет)
+pid_t procsubst_pgid(void) {
+    return ps_pgid;
+}
+
+// в ребенке перед exec: /dev/fd/N должны пережить exec
+void procsubst_exec_prepare(void) {
+    for (int i = 0; i < ps_count; ++i) {
+        fcntl(ps_fds[i], F_SETFD, 0);
+    }
+}
+
+// концы /dev/fd/N, которые должна получить команда (для zygote)
+int procsubst_fds(const int **fds) {
+    *fds = ps_fds;
+    return ps_count;
+}
+
+// после fork команды закрываем свои концы; пиды помощников отдаем для ожидания
+int procsubst_release(pid_t **pids) {
+    int n = ps_count;
+    *pids = NULL;
+
+    for (int i = 0; i < ps_count; ++i) {
+        close(ps_fds[i]);
+    }
+
+    if (n > 0) {
+        *pids = malloc(sizeof(pid_t) * n);
+        if (*pids) memcpy(*pids, ps_pids, sizeof(pid_t) * n);
+    }
+
+    ps_count = 0;
+    ps_pgid = 0;
+    return *pids ? n : 0;
+}
+
+// без управления заданиями помощников дожидаемся явно
+void procsubst_wait(pid_t *pids, int n) {
+    for (int i = 0; i < n; ++i) {
+        while (waitpid(pids[i], NULL, 0) < 0 && errno == EINTR);
+    }
+}
@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include "../inc/rlimits.h"
+#include "../inc/options.h"
+#include "../inc/outbuf.h"
+#include <linux/ioprio.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define BGNICE_IOLEVEL 7 // фоновые задания - низший уровень best-effort, не idle: idle может голодать
+
+static const char *ioclass_names[] = {
+    [IOPRIO_CLASS_NONE] = "none",
+    [IOPRIO_CLASS_RT]   = "rt",
+    [IOPRIO_CLASS_BE]   = "be",
+    [IOPRIO_CLASS_IDLE] = "idle",
+};
+
+// idle, be[:N], rt[:N] или просто N (уровень best-effort)
+static int parse_ioprio(const char *s, JobLimits *lim) {
+    const char *level = NULL;
+    int cls = -1;
+
+    if (s[0] >= '0' && s[0] <= '9') {
+        cls = IOPRIO_CLASS_BE;
+        level = s;
+    } else {
+        for (int i = IOPRIO_CLASS_RT; i <= IOPRIO_CLASS_IDLE; ++i) {
+            size_t len = strlen(ioclass_names[i]);
+            if (strncmp(s, ioclass_names[i], len) == 0 && (s[len] == '\0' || s[len] == ':')) {
+                cls = i;
+                if (s[len] == ':') level = s + len + 1;
+                break;
+            }
+        }
+    }
+    if (cls < 0) return 1;
+
+    int lvl = 4; // уровень по умолчанию у ядра
+    if (level) {
+        char *end = NULL;
+        lvl = (int)strtol(level, &end, 10);
+        if (end == level || *end != '\0' || lvl < 0 || lvl > 7) return 1;
+        if (cls == IOPRIO_CLASS_IDLE) return 1; // у idle уровней нет
+    }
+
+    lim->ioclass = cls;
+    lim->iolevel = cls == IOPRIO_CLASS_IDLE ? 0 : lvl;
+    return 0;
+}
+
+#define CPU_WORD_BITS (8 * sizeof(unsigned long))
+
+static void cpu_mark(JobLimits *lim, int cpu) {
+    lim->cpus[cpu / CPU_WORD_BITS] |= 1UL << (cpu % CPU_WORD_BITS);
+}
+
+static int cpu_marked(const JobLimits *lim, int cpu) {
+    return (lim->cpus[cpu / CPU_WORD_BITS] >> (cpu % CPU_WORD_BITS)) & 1;
+}
+
+// список ядер как у taskset -c: 0-3,6,8-15
+int parse_cpu_list(const char *s, JobLimits *lim) {
+    memset(lim->cpus, 0, sizeof(lim->cpus));
+
+    while (*s) {
+        char *end = NULL;
+        long lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= LIMIT_MAX_CPUS) return 1;
+        long hi = lo;
+
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi >= LIMIT_MAX_CPUS) return 1;
+            s = end;
+        }
+        for (long c = lo; c <= hi; ++c) cpu_mark(lim, (int)c);
+
+        if (*s == ',') s++;
+        else if (*s != '\0') return 1;
+    }
+
+    lim->set |= LIMIT_CPUS;
+    return 0;
+}
+
+// разбор опций limit; возвращает индекс команды в argv или -1 при ошибке.
+// report = 0 - без сообщений (повторный разбор ради jobs -l)
+int limits_parse(char **argv, JobLimits *lim, int report) {
+    memset(lim, 0, sizeof(*lim));
+    int i = 1;
+
+    while (argv[i] && argv[i][0] == '-') {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--") == 0) {
+            i++;
+            break;
+        }
+
+        const char *val = argv[i + 1];
+        if (!val) {
+            if (report) out_errorf("limit: %s: option requires an argument\n", opt);
+            return -1;
+        }
+
+        char *end = NULL;
+        if (strcmp(opt, "-m") == 0) {
+            long v;
+            if (parse_size(val, &v) != 0) goto bad;
+            lim->mem = (rlim_t)v;
+            lim->set |= LIMIT_MEM;
+        } else if (strcmp(opt, "-t") == 0) {
+            long v = strtol(val, &end, 10);
+            if (end == val || *end != '\0' || v < 0) goto bad;
+            lim->cpu = (rlim_t)v;
+            lim->set |= LIMIT_CPU;
+        } else if (strcmp(opt, "-n") == 0) {
+            long v = strtol(val, &end, 10);
+            if (end == val || *end != '\0' || v < -20 || v > 19) goto bad;
+            lim->nice = (int)v;
+            lim->set |= LIMIT_NICE;
+        } else if (strcmp(opt, "-io") == 0) {
+            if (parse_ioprio(val, lim) != 0) goto bad;
+            lim->set |= LIMIT_IO;
+        } else if (strcmp(opt, "-c") == 0) {
+            if (parse_cpu_list(val, lim) != 0) goto bad;
+        } else {
+            if (report) out_errorf("limit: %s: unknown option\n", opt);
+            return -1;
+        }
+        i += 2;
+        continue;
+bad:
+        if (report) out_errorf("limit: %s: bad value: %s\n", opt, val);
+        return -1;
+    }
+
+    return i;
+}
+
+static int set_rlimit(int resource, rlim_t value, const char *what) {
+    // мягкий и жесткий предел вместе: запущенная программа не поднимет его обратно
+    struct rlimit rl = { value, value };
+    if (setrlimit(resource, &rl) != 0) {
+        out_perror(what);
+        return 1;
+    }
+    return 0;
+}
+
+// вызывается в дочернем процессе перед exec
+int limits_apply(const JobLimits *lim) {
+    if (!lim || !lim->set) return 0;
+
+    if ((lim->set & LIMIT_MEM) && set_rlimit(RLIMIT_AS, lim->mem, "limit: memory")) return 1;
+    if ((lim->set & LIMIT_CPU) && set_rlimit(RLIMIT_CPU, lim->cpu, "limit: cpu time")) return 1;
+
+    if ((lim->set & LIMIT_NICE) && setpriority(PRIO_PROCESS, 0, lim->nice) != 0) {
+        out_perror("limit: nice");
+        return 1;
+    }
+
+    if (lim->set & LIMIT_CPUS) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c = 0; c < LIMIT_MAX_CPUS && c < CPU_SETSIZE; ++c) {
+            if (cpu_marked(lim, c)) CPU_SET(c, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            out_perror("limit: affinity");
+            return 1;
+        }
+    }
+
+    if (lim->set & LIMIT_IO) {
+        // у glibc нет обертки для ioprio_set
+        int prio = IOPRIO_PRIO_VALUE(lim->ioclass, lim->iolevel);
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio) != 0) {
+            out_perror("limit: ioprio");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// set -o bgnice[=N]: задания с & получают nice N и низший приоритет ввода-вывода.
+// Nice только повышается: непривилегированный процесс не может его понизить.
+int limits_background(JobLimits *lim) {
+    memset(lim, 0, sizeof(*lim));
+    if (!get_option(OPT_BGNICE)) return 0;
+
+    int nice = (int)get_option_value(OPT_BGNICE);
+    if (nice > 19) nice = 19;
+    if (getpriority(PRIO_PROCESS, 0) < nice) {
+        lim->nice = nice;
+        lim->set |= LIMIT_NICE;
+    }
+
+    lim->ioclass = IOPRIO_CLASS_BE;
+    lim->iolevel = BGNICE_IOLEVEL;
+    lim->set |= LIMIT_IO;
+    return 1;
+}
+
+// set -o cpuspread: стадия конвейера stage получает одно ядро из доступных шеллу, по кругу
+int limits_spread(int stage, JobLimits *lim) {
+    memset(lim, 0, sizeof(*lim));
+    if (!get_option(OPT_CPUSPREAD)) return 0;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+
+    int n = CPU_COUNT(&allowed);
+    if (n <= 1) return 0;
+
+    int want = stage % n;
+    for (int c = 0; c < CPU_SETSIZE && c < LIMIT_MAX_CPUS; ++c) {
+        if (!CPU_ISSET(c, &allowed)) continue;
+        if (want-- == 0) {
+            cpu_mark(lim, c);
+            lim->set |= LIMIT_CPUS;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// заданные в src поля перекрывают dst
+void limits_merge(JobLimits *dst, const JobLimits *src) {
+    if (src->set & LIMIT_MEM) dst->mem = src->mem;
+    if (src->set & LIMIT_CPU) dst->cpu = src->cpu;
+    if (src->set & LIMIT_NICE) dst->nice = src->nice;
+    if (src->set & LIMIT_IO) {
+        dst->ioclass = src->ioclass;
+        dst->iolevel = src->iolevel;
+    }
+    if (src->set & LIMIT_CPUS) memcpy(dst->cpus, src->cpus, sizeof(dst->cpus));
+    dst->set |= src->set;
+}
+
+static void format_size(rlim_t v, char *buf, size_t size) {
+    static const char suffix[] = "kmg";
+    int unit = -1;
+    while (unit < 2 && v != 0 && v % 1024 == 0) {
+        v /= 1024;
+        unit++;
+    }
+    if (unit < 0) snprintf(buf, size, "%llu", (unsigned long long)v);
+    else snprintf(buf, size, "%llu%c", (unsigned long long)v, suffix[unit]);
+}
+
+// в виде опций limit, чтобы строку из jobs -l можно было повторить
+void limits_format(const JobLimits *lim, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+
+    if (lim->set & LIMIT_MEM) {
+        char mem[32];
+        format_size(lim->mem, mem, sizeof(mem));
+        len += snprintf(buf + len, size - len, " -m %s", mem);
+    }
+    if ((lim->set & LIMIT_CPU) && len < size) {
+        len += snprintf(buf + len, size - len, " -t %llu", (unsigned long long)lim->cpu);
+    }
+    if ((lim->set & LIMIT_NICE) && len < size) {
+        len += snprintf(buf + len, size - len, " -n %d", lim->nice);
+    }
+    if ((lim->set & LIMIT_CPUS) && len < size) {
+        len += snprintf(buf + len, size - len, " -c ");
+        for (int c = 0; c < LIMIT_MAX_CPUS && len < size; ++c) {
+            if (!cpu_marked(lim, c) || (c > 0 && cpu_marked(lim, c - 1))) continue;
+
+            // начало участка - ищем его конец
+            int hi = c;
+            while (hi + 1 < LIMIT_MAX_CPUS && cpu_marked(lim, hi + 1)) hi++;
+
+            const char *sep = buf[len - 1] == ' ' ? "" : ",";
+            if (hi == c) len += snprintf(buf + len, size - len, "%s%d", sep, c);
+            else len += snprintf(buf + len, size - len, "%s%d-%d", sep, c, hi);
+        }
+    }
+    if ((lim->set & LIMIT_IO) && len < size) {
+        if (lim->ioclass == IOPRIO_CLASS_IDLE) {
+            snprintf(buf + len, size - len, " -io idle");
+        } else {
+            snprintf(buf + len, size - len, " -io %s:%d", ioclass_names[lim->ioclass], lim->iolevel);
+        }
+    }
+}
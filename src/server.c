@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+
+#include "../inc/server.h"
+#include "../inc/jobs.h"
+#include "../inc/outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define SERVER_MAX_REQUEST (1024 * 1024)  // длиннее - соединение закрывается
+#define SERVER_FDS 3                       // stdin, stdout, stderr запроса
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int fds[SERVER_FDS];  // пришедшие с запросом дескрипторы, по порядку 0-2
+    int nfds;
+} Client;
+
+static void drop_fds(Client *c) {
+    for (int i = 0; i < c->nfds; ++i) close(c->fds[i]);
+    c->nfds = 0;
+}
+
+// читаем следующую порцию; дескрипторы из SCM_RIGHTS копим до конца запроса
+static ssize_t client_read(int sock, Client *c) {
+    if (c->cap - c->len < 4096) {
+        size_t cap = c->cap ? c->cap * 2 : 8192;
+        char *p = realloc(c->data, cap);
+        if (!p) return -1;
+        c->data = p;
+        c->cap = cap;
+    }
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * SERVER_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { .iov_base = c->data + c->len, .iov_len = c->cap - c->len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR);
+    if (n <= 0) return n;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        int cnt = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *p = (int *)CMSG_DATA(cm);
+        for (int i = 0; i < cnt; ++i) {
+            if (c->nfds < SERVER_FDS) c->fds[c->nfds++] = p[i];
+            else close(p[i]);
+        }
+    }
+    c->len += n;
+    return n;
+}
+
+// выделяем готовый запрос: 1 - есть (строка в *line, len байт съедено), 0 - ждем еще, -1 - ошибка
+static int next_request(Client *c, char **line, size_t *used) {
+    if (c->len == 0) return 0;
+
+    if (c->data[0] == '\0') {
+        if (c->len < 5) return 0;
+        unsigned char *h = (unsigned char *)c->data + 1;
+        uint32_t n = (uint32_t)h[0] << 24 | (uint32_t)h[1] << 16 | (uint32_t)h[2] << 8 | h[3];
+        if (n > SERVER_MAX_REQUEST) return -1;
+        if (c->len < 5 + (size_t)n) return 0;
+        *line = strndup(c->data + 5, n);
+        *used = 5 + n;
+        return *line ? 1 : -1;
+    }
+
+    char *nl = memchr(c->data, '\n', c->len);
+    if (!nl) return c->len > SERVER_MAX_REQUEST ? -1 : 0;
+    *line = strndup(c->data, nl - c->data);
+    *used = nl - c->data + 1;
+    return *line ? 1 : -1;
+}
+
+// 0-2 обработчика между запросами смотрят в /dev/null
+static void null_stdio(void) {
+    int null = open("/dev/null", O_RDWR);
+    if (null < 0) return;
+    for (int fd = 0; fd < SERVER_FDS; ++fd) dup2(null, fd);
+    if (null >= SERVER_FDS) close(null);
+}
+
+// ставим дескрипторы запроса на 0-2, недостающие остаются /dev/null
+static int install_fds(Client *c) {
+    int rc = 0;
+    for (int fd = 0; fd < c->nfds; ++fd) {
+        if (dup2(c->fds[fd], fd) < 0) {
+            perror("server: dup2");
+            rc = 1;
+        }
+    }
+    drop_fds(c);
+    return rc;
+}
+
+static double tv_sec(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int send_status(int sock, int rc, struct rusage *self0, struct rusage *kids0) {
+    struct rusage self, kids;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &kids);
+
+    // время самого обработчика и всех дождавшихся детей за запрос
+    double ut = tv_sec(self.ru_utime) - tv_sec(self0->ru_utime) + tv_sec(kids.ru_utime) - tv_sec(kids0->ru_utime);
+    double st = tv_sec(self.ru_stime) - tv_sec(self0->ru_stime) + tv_sec(kids.ru_stime) - tv_sec(kids0->ru_stime);
+    // ru_maxrss - пик, а не счетчик: разность по запросу не посчитать. Обработчик
+    // после fork начинает с нулевыми данными детей, так что это самый большой процесс,
+    // дождавшийся в этом соединении; память самого обработчика - память сервера, её не берем
+    long rss = kids.ru_maxrss;
+
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "status %d utime %.6f stime %.6f childrss %ld\n", rc, ut, st, rss);
+    for (int off = 0; off < n;) {
+        ssize_t w = send(sock, buf + off, n - off, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        off += w;
+    }
+    return 0;
+}
+
+// обработчик одного соединения: запросы выполняются по очереди
+static void serve_client(MyBash *sh, int sock) {
+    Client c = { .data = NULL };
+    null_stdio();
+
+    for (;;) {
+        char *line = NULL;
+        size_t used = 0;
+        int got = next_request(&c, &line, &used);
+        if (got < 0) break;
+        if (got == 0) {
+            if (client_read(sock, &c) <= 0) break;
+            continue;
+        }
+        memmove(c.data, c.data + used, c.len - used);
+        c.len -= used;
+
+        struct rusage self0, kids0;
+        getrusage(RUSAGE_SELF, &self0);
+        getrusage(RUSAGE_CHILDREN, &kids0);
+
+        int rc = install_fds(&c) == 0 ? mybash_run(sh, line, 0) : 1;
+        free(line);
+
+        // не держим дескрипторы клиента между запросами
+        null_stdio();
+
+        if (send_status(sock, rc, &self0, &kids0) != 0) break;
+
+        // exit завершает сеанс, но ответ на него клиент получает, как на любой запрос
+        if (mybash_exited(sh)) break;
+    }
+
+    drop_fds(&c);
+    free(c.data);
+    close(sock);
+}
+
+int server_main(MyBash *sh, const char *path, int max_clients) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "server: path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        perror("server: socket");
+        return 1;
+    }
+
+    // старый сокет от упавшего сервера мешает bind
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 128) < 0) {
+        perror(path);
+        close(lfd);
+        return 1;
+    }
+
+    int active = 0;
+    for (;;) {
+        // завершившиеся обработчики освобождают места
+        while (active > 0 && waitpid(-1, NULL, active >= max_clients ? 0 : WNOHANG) > 0) active--;
+        if (active >= max_clients) continue;
+
+        int sock = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("server: accept");
+            break;
+        }
+
+        out_flush_all();
+        pid_t pid = fork();
+        if (pid == 0) {
+            shell_pid = getpid(); // обработчик - самостоятельный шелл, а не подоболочка
+            close(lfd);
+            serve_client(sh, sock);
+            _exit(0);
+        }
+        if (pid < 0) perror("server: fork");
+        else active++;
+        close(sock);
+    }
+
+    close(lfd);
+    return 1;
+}
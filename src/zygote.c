@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+
+#include "../inc/zygote.h"
+#include "../inc/execution.h"
+#include "../inc/jobs.h"
+#include "../inc/options.h"
+#include "../inc/procsubst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
+extern int shell_terminal;
+extern int shell_is_interactive;
+
+#define ZYGOTE_MAX_FDS 16            // 0-2 и дескрипторы n>file команды
+#define ZYGOTE_MAX_MSG (64 * 1024)   // argv и окружение длиннее - обычный fork
+
+#define ZYGOTE_SOCK_MIN 64  // свой конец сокета держим выше пользовательских n>file
+
+#define ZY_JOB 1  // управление заданиями: setpgid, терминал, сигналы по умолчанию
+
+// Запрос шелла. За ним в том же сообщении строки argv, затем изменения
+// окружения: "NAME=VALUE" - установить, "NAME" - удалить.
+// Дескрипторы в SCM_RIGHTS: каталог (O_PATH), терминал при ZY_JOB,
+// затем по одному на каждую неотрицательную цель targets.
+typedef struct {
+    int flags;
+    pid_t pgid;     // группа ребенка, 0 - своя собственная
+    int argc;
+    int nenv;
+    int nfds;
+    int targets[ZYGOTE_MAX_FDS];  // номер в ребенке; -1 - fd - закрыть
+} ZygoteReq;
+
+// ---- сторона шелла ----
+
+static int zy_fd = -1;
+static pid_t zy_pid = 0;
+static pid_t zy_owner = 0;  // помощник порождает сыновей только этого процесса
+
+// окружение, которое уже знает помощник: копии строк и указатели environ
+static char **zy_env = NULL;
+static char **zy_envp = NULL;
+static int zy_nenv = 0;
+
+static char *zy_buf = NULL;
+static size_t zy_len = 0;
+static size_t zy_cap = 0;
+
+static int buf_add(const char *s) {
+    size_t n = strlen(s) + 1;
+    if (zy_len + n > ZYGOTE_MAX_MSG) return 1;
+    if (zy_len + n > zy_cap) {
+        size_t cap = zy_cap ? zy_cap * 2 : 4096;
+        while (cap < zy_len + n) cap *= 2;
+        char *p = realloc(zy_buf, cap);
+        if (!p) return 1;
+        zy_buf = p;
+        zy_cap = cap;
+    }
+    memcpy(zy_buf + zy_len, s, n);
+    zy_len += n;
+    return 0;
+}
+
+static void env_forget(void) {
+    for (int i = 0; i < zy_nenv; ++i) free(zy_env[i]);
+    free(zy_env);
+    free(zy_envp);
+    zy_env = NULL;
+    zy_envp = NULL;
+    zy_nenv = 0;
+}
+
+// запоминаем environ как известный помощнику
+static void env_remember(void) {
+    int n = 0;
+    while (environ[n]) n++;
+    env_forget();
+    zy_env = malloc(sizeof(char *) * (n + 1));
+    zy_envp = malloc(sizeof(char *) * (n + 1));
+    if (!zy_env || !zy_envp) {
+        free(zy_env);
+        free(zy_envp);
+        zy_env = zy_envp = NULL;
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        zy_env[i] = strdup(environ[i]);
+        zy_envp[i] = environ[i];
+    }
+    zy_nenv = n;
+}
+
+static int env_has_name(char **env, int n, const char *entry) {
+    size_t len = strcspn(entry, "=");
+    for (int i = 0; i < n; ++i) {
+        if (strncmp(env[i], entry, len) == 0 && env[i][len] == '=') return 1;
+    }
+    return 0;
+}
+
+// изменения окружения со времени прошлого запроса; -1 - не влезли в сообщение.
+// glibc не переиспользует строки environ, поэтому совпавший указатель - та же строка
+static int env_delta(void) {
+    int n = 0, same = 1;
+    for (; environ[n]; ++n) {
+        if (n >= zy_nenv || environ[n] != zy_envp[n]) same = 0;
+    }
+    if (same && n == zy_nenv) return 0;
+
+    int count = 0;
+    for (int i = 0; i < n; ++i) {
+        if (i < zy_nenv && environ[i] == zy_envp[i]) continue;
+        int known = 0;
+        for (int j = 0; j < zy_nenv && !known; ++j) known = strcmp(zy_env[j], environ[i]) == 0;
+        if (known) continue;
+        if (buf_add(environ[i]) != 0) return -1;
+        count++;
+    }
+    for (int j = 0; j < zy_nenv; ++j) {
+        if (env_has_name(environ, n, zy_env[j])) continue;
+        char name[256];
+        size_t len = strcspn(zy_env[j], "=");
+        if (len >= sizeof(name)) return -1;
+        memcpy(name, zy_env[j], len);
+        name[len] = '\0';
+        if (buf_add(name) != 0) return -1;
+        count++;
+    }
+    return count;
+}
+
+static int zygote_start(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("zygote: socketpair");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("zygote: fork");
+        close(sv[0]);
+        close(sv[1]);
+        return 1;
+    }
+    if (pid == 0) {
+        // свежий образ того же бинарника: куча шелла помощнику не достается
+        if (dup2(sv[1], ZYGOTE_FD) < 0 || fcntl(ZYGOTE_FD, F_SETFD, 0) < 0) _exit(1);
+        // помощник живет дольше команды, при которой его запустили: её 0-2
+        // (например, { ...; } > fifo) он держал бы до конца. Свои 0-2 каждый
+        // запуск и так получает через SCM_RIGHTS
+        int null = open("/dev/null", O_RDWR);
+        if (null < 0) _exit(1);
+        for (int fd = 0; fd <= 2; ++fd) {
+            if (null != fd) dup2(null, fd);
+        }
+        if (null > 2) close(null);
+        char *argv[] = { "mybash-zygote", ZYGOTE_ARG, NULL };
+        execv("/proc/self/exe", argv);
+        perror("zygote: exec");
+        _exit(127);
+    }
+
+    close(sv[1]);
+    zy_fd = fcntl(sv[0], F_DUPFD_CLOEXEC, ZYGOTE_SOCK_MIN);
+    close(sv[0]);
+    if (zy_fd < 0) {
+        perror("zygote: fcntl");
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR);
+        return 1;
+    }
+    zy_pid = pid;
+    zy_owner = getpid();
+    env_remember();
+    return 0;
+}
+
+void zygote_stop(void) {
+    if (zy_fd < 0) return;
+    close(zy_fd);
+    zy_fd = -1;
+    // помощник есть только у zy_owner; копия сокета в подоболочке просто закрывается
+    if (zy_owner == getpid()) {
+        while (waitpid(zy_pid, NULL, 0) < 0 && errno == EINTR);
+    }
+    zy_pid = 0;
+    env_forget();
+}
+
+static int add_target(int *targets, int *n, int fd) {
+    for (int i = 0; i < *n; ++i) {
+        if (targets[i] == fd) return 0;
+    }
+    if (*n >= ZYGOTE_MAX_FDS) return 1;
+    targets[(*n)++] = fd;
+    return 0;
+}
+
+// отправляем запрос и ждем пид; 0 - помощник недоступен, -1 - ошибка
+static pid_t send_request(ZygoteReq *req, int *fds, int nfds) {
+    struct iovec iov[2] = {
+        { .iov_base = req, .iov_len = sizeof(*req) },
+        { .iov_base = zy_buf, .iov_len = zy_len },
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * (ZYGOTE_MAX_FDS + 2))];
+        struct cmsghdr align;
+    } ctl;
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+
+    ssize_t n;
+    while ((n = sendmsg(zy_fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+    if (n < 0) {
+        // помощник умер - запрос не дошел, можно просто сделать fork
+        zygote_stop();
+        return 0;
+    }
+
+    pid_t pid;
+    while ((n = recv(zy_fd, &pid, sizeof(pid), 0)) < 0 && errno == EINTR);
+    if (n != sizeof(pid)) {
+        // запрос ушел, а ответа нет: повторять нельзя, команда могла запуститься
+        fprintf(stderr, "zygote: helper lost\n");
+        zygote_stop();
+        return -1;
+    }
+    if (pid < 0) {
+        errno = -pid;
+        perror("zygote: clone");
+        return -1;
+    }
+    return pid;
+}
+
+// Запуск внешней команды через помощника. Перенаправления применяются в шелле,
+// помощнику уходят готовые 0-2 и затронутые дескрипторы, потом шелл их восстанавливает.
+// Возвращает пид ребенка, 0 - помощник не используется (нужен fork), -1 - ошибка.
+pid_t zygote_spawn(ASTNode *node, pid_t pgid) {
+    if (!get_option(OPT_ZYGOTE)) {
+        if (zy_fd >= 0) zygote_stop();
+        return 0;
+    }
+    if (zy_fd >= 0 && zy_owner != getpid()) zygote_stop();  // подоболочка
+    if (zy_fd < 0 && (getpid() != shell_pid || zygote_start() != 0)) return 0;
+
+    zy_len = 0;
+    ZygoteReq req = { .flags = shell_is_interactive ? ZY_JOB : 0, .pgid = pgid };
+    for (char **a = node->command.argv; *a; ++a) {
+        if (buf_add(*a) != 0) return 0;
+        req.argc++;
+    }
+    req.nenv = env_delta();
+    if (req.nenv < 0) return 0;
+
+    RedirPlan *plan = &node->command.plan;
+    for (int fd = 0; fd <= 2; ++fd) add_target(req.targets, &req.nfds, fd);
+    for (int i = 0; i < plan->n_touched; ++i) {
+        if (plan->touched[i] == zy_fd) return 0;  // перенаправление закрыло бы сокет
+        if (add_target(req.targets, &req.nfds, plan->touched[i]) != 0) return 0;
+    }
+    const int *ps;
+    int nps = procsubst_fds(&ps);
+    for (int i = 0; i < nps; ++i) {
+        if (add_target(req.targets, &req.nfds, ps[i]) != 0) return 0;
+    }
+
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) return 0;
+    for (int i = 0; i < plan->n_touched; ++i) {
+        if (plan->touched[i] != cwd) continue;
+        // n>file занял бы этот номер раньше, чем каталог уйдет помощнику
+        int fd = fcntl(cwd, F_DUPFD_CLOEXEC, ZYGOTE_SOCK_MIN);
+        close(cwd);
+        if (fd < 0) return 0;
+        cwd = fd;
+        break;
+    }
+
+    int saved[plan->n_touched > 0 ? plan->n_touched : 1];
+    if (plan->n_redirs && save_redir_fds(plan, saved) != 0) {
+        close(cwd);
+        return -1;
+    }
+
+    pid_t pid = -1;
+    if (!plan->n_redirs || handle_redirection(node->command.redir) == 0) {
+        int fds[ZYGOTE_MAX_FDS + 2];
+        int nfds = 0;
+        fds[nfds++] = cwd;
+        if (req.flags & ZY_JOB) fds[nfds++] = shell_terminal;
+        for (int i = 0; i < req.nfds; ++i) {
+            int fd = req.targets[i];
+            if (fcntl(fd, F_GETFD) < 0) {
+                req.targets[i] = -1 - fd;  // n>&- : в ребенке закрыт
+            } else {
+                fds[nfds++] = fd;
+            }
+        }
+        pid = send_request(&req, fds, nfds);
+    }
+
+    if (plan->n_redirs) restore_redir_fds(plan, saved);
+    close(cwd);
+    if (pid > 0) env_remember();
+    return pid;
+}
+
+// ---- сторона помощника ----
+
+static char zy_msg[sizeof(ZygoteReq) + ZYGOTE_MAX_MSG];
+static char *zy_argv[ZYGOTE_MAX_MSG / 2 + 1];  // каждое слово - минимум 2 байта
+
+static void zygote_child(ZygoteReq *req, int *fds, char **argv) {
+    if (fchdir(fds[0]) < 0) perror("zygote: fchdir");
+
+    int k = 1;
+    if (req->flags & ZY_JOB) {
+        setpgid(0, req->pgid);
+        tcsetpgrp(fds[k++], req->pgid ? req->pgid : getpid());
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+
+    // сначала уводим полученные дескрипторы выше всех целей, потом ставим на места
+    int base = 10;
+    for (int i = 0; i < req->nfds; ++i) {
+        int t = req->targets[i] >= 0 ? req->targets[i] : -1 - req->targets[i];
+        if (t >= base) base = t + 1;
+    }
+    int high[ZYGOTE_MAX_FDS];
+    for (int i = 0; i < req->nfds; ++i) {
+        if (req->targets[i] < 0) continue;
+        high[i] = fcntl(fds[k++], F_DUPFD_CLOEXEC, base);
+        if (high[i] < 0) {
+            perror("zygote: fcntl");
+            _exit(1);
+        }
+    }
+    for (int i = 0; i < req->nfds; ++i) {
+        if (req->targets[i] < 0) {
+            close(-1 - req->targets[i]);
+        } else if (dup2(high[i], req->targets[i]) < 0) {
+            perror("zygote: dup2");
+            _exit(1);
+        }
+    }
+
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: command not found\n", argv[0]);
+    _exit(127);
+}
+
+static void reply(int sock, pid_t pid) {
+    while (send(sock, &pid, sizeof(pid), MSG_NOSIGNAL) < 0 && errno == EINTR);
+}
+
+// цикл помощника; выходит, когда шелл закрыл свой конец сокета
+int zygote_main(int sock) {
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    close_range(sock + 1, ~0U, 0);
+    prctl(PR_SET_NAME, "mybash-zygote");
+
+    char **argv = zy_argv;
+    for (;;) {
+        union {
+            char buf[CMSG_SPACE(sizeof(int) * (ZYGOTE_MAX_FDS + 2))];
+            struct cmsghdr align;
+        } ctl;
+        struct iovec iov = { .iov_base = zy_msg, .iov_len = sizeof(zy_msg) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+
+        ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+
+        int fds[ZYGOTE_MAX_FDS + 2];
+        int nfds = 0;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+            int cnt = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int *p = (int *)CMSG_DATA(cm);
+            for (int i = 0; i < cnt; ++i) {
+                if (nfds < ZYGOTE_MAX_FDS + 2) fds[nfds++] = p[i];
+                else close(p[i]);
+            }
+        }
+
+        ZygoteReq *req = (ZygoteReq *)zy_msg;
+        int want = 1 + ((size_t)n >= sizeof(*req) && (req->flags & ZY_JOB));
+        int ok = (size_t)n >= sizeof(*req) && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+                 && req->argc > 0 && req->argc <= ZYGOTE_MAX_MSG / 2
+                 && req->nenv >= 0 && req->nfds >= 0 && req->nfds <= ZYGOTE_MAX_FDS;
+        if (ok) {
+            for (int i = 0; i < req->nfds; ++i) want += req->targets[i] >= 0;
+            ok = nfds == want;
+        }
+
+        // разбираем строки: argv, затем изменения окружения
+        char *s = zy_msg + sizeof(*req);
+        char *end = zy_msg + n;
+        for (int i = 0; ok && i < req->argc + req->nenv; ++i) {
+            char *z = memchr(s, '\0', end - s);
+            if (!z) {
+                ok = 0;
+                break;
+            }
+            if (i < req->argc) {
+                argv[i] = s;
+            } else {
+                char *eq = strchr(s, '=');
+                if (eq) {
+                    *eq = '\0';
+                    setenv(s, eq + 1, 1);
+                } else {
+                    unsetenv(s);
+                }
+            }
+            s = z + 1;
+        }
+
+        pid_t pid = -EINVAL;
+        if (ok) {
+            argv[req->argc] = NULL;
+            // CLONE_PARENT: ребенок - сын шелла, помощнику ждать некого
+            pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+            if (pid == 0) zygote_child(req, fds, argv);
+            if (pid < 0) pid = -errno;
+        }
+
+        for (int i = 0; i < nfds; ++i) close(fds[i]);
+        reply(sock, pid);
+    }
+}